@@ -0,0 +1,94 @@
+#!/bin/bash
+# Scaling benchmark for nyuenc.
+# Usage: ./bench.sh [input-size-MB] [nyuenc binaries...]
+# With no binaries given, compares ./nyuenc against nyuenc.c as it was before
+# the lock-free task ring (the mutex-guarded linked-list queue), or against
+# $BASE_REV when set, built into a temp directory. ./nyuenc and the baseline are
+# both rebuilt with the Makefile's CFLAGS plus -O2 (the Makefile itself does not
+# optimize), or with $CFLAGS when set.
+#
+# MODE=chunks ./bench.sh [input-size-MB] instead sweeps ./nyuenc -c from 4 KB
+# to 16 MB (rows) at the job counts in $JOBS (columns, default "1 4 16").
+#
+# MODE=input ./bench.sh [input-size-MB] compares the -I input backends with a
+# cold page cache (the input's pages are dropped with POSIX_FADV_DONTNEED
+# before every run) and a warm one. Set BENCH_FILE to benchmark a file on the
+# device of interest (NVMe, NFS, ...) instead of a generated one.
+
+size_mb=${1:-256}
+shift
+bins=("$@")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cflags=${CFLAGS:-$(make -s -p -n nyuenc 2>/dev/null | sed -n 's/^CFLAGS = //p' | head -1) -O2}
+if [ "$MODE" = chunks ] || [ "$MODE" = input ]; then
+    make -s -B nyuenc CFLAGS="$cflags" || exit 1
+elif [ ${#bins[@]} -eq 0 ]; then
+    # the single-file nyuenc.c from before the first backlog change (the ring)
+    base=${BASE_REV:-$(git log --reverse --format=%H --grep='^\[user-001\]' | head -1)~1}
+    make -s -B nyuenc CFLAGS="$cflags" || exit 1
+    git show "$base:lab3/nyuenc.c" > "$tmp/nyuenc_base.c" || exit 1
+    gcc $cflags -pthread -o "$tmp/nyuenc_base" "$tmp/nyuenc_base.c" || exit 1
+    bins=(./nyuenc "$tmp/nyuenc_base")
+fi
+
+# mixed input: short runs (every run well under 255 so every version agrees)
+[ -n "$BENCH_FILE" ] || python3 - "$tmp/input" "$size_mb" <<'PY'
+import random, sys
+random.seed(1)
+block = bytearray()
+while len(block) < 1 << 20:
+    block += bytes([random.randrange(97, 123)]) * random.randrange(1, 40)
+with open(sys.argv[1], "wb") as f:
+    for _ in range(int(sys.argv[2])):
+        f.write(block[:1 << 20])
+PY
+
+input=${BENCH_FILE:-$tmp/input}
+
+run() {
+    start=$(date +%s.%N)
+    "$@" "$input" > /dev/null
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" 'BEGIN { printf "%14.3f", e - s }'
+}
+
+drop_cache() {
+    python3 -c 'import os, sys; fd = os.open(sys.argv[1], os.O_RDONLY); os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)' "$input"
+}
+
+if [ "$MODE" = input ]; then
+    j=${JOBS:-4}
+    printf "%-10s%14s%14s   (seconds, -j %s)\n" "backend" "cold" "warm" "$j"
+    for b in mmap populate pread direct uring; do
+        printf "%-10s" "$b"
+        drop_cache
+        run ./nyuenc -j "$j" -I "$b"
+        run ./nyuenc -j "$j" -I "$b"
+        printf "\n"
+    done
+    exit 0
+fi
+
+if [ "$MODE" = chunks ]; then
+    jobs=(${JOBS:-1 4 16})
+    printf "%-8s" "chunk"
+    for j in "${jobs[@]}"; do printf "%14s" "-j $j"; done
+    printf "   (seconds, input %s MB)\n" "$size_mb"
+    for c in 4K 16K 64K 256K 1M 4M 16M; do
+        printf "%-8s" "$c"
+        for j in "${jobs[@]}"; do run ./nyuenc -j "$j" -c "$c"; done
+        printf "\n"
+    done
+    exit 0
+fi
+
+printf "%-6s" "jobs"
+for b in "${bins[@]}"; do printf "%14s" "$(basename "$b")"; done
+printf "   (seconds, input %s MB)\n" "$size_mb"
+for j in 1 2 4 8 16 32; do
+    printf "%-6s" "$j"
+    for b in "${bins[@]}"; do run "$b" -j "$j"; done
+    printf "\n"
+done
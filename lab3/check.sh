@@ -0,0 +1,221 @@
+#!/bin/bash
+# Correctness check for nyuenc.
+# Usage: ./check.sh [nyuenc binary]
+# Encodes small inputs whose encodings are spelled out below, then generated
+# inputs, comparing ./nyuenc's output with nyuenc.c as it was before the first
+# backlog change (or $BASE_REV when set), built into a temp directory. Then
+# decodes, and encodes through a libnyuenc client linked with ./libnyuenc.a.
+# Prints one line per case and exits 1 if any failed.
+
+bin=$(realpath "${1:-./nyuenc}")
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+base=${BASE_REV:-$(cd "$dir" && git log --reverse --format=%H --grep='^\[user-001\]' | head -1)~1}
+(cd "$dir" && git show "$base:lab3/nyuenc.c") > "$tmp/nyuenc_base.c" || exit 1
+gcc -O2 -pthread -o "$tmp/nyuenc_base" "$tmp/nyuenc_base.c" || exit 1
+cd "$tmp" || exit 1
+
+failed=0
+# case name, then two files that must be byte-for-byte equal
+same(){
+    if cmp -s "$2" "$3"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        failed=1
+    fi
+}
+
+# case name, then a command that must exit non-zero without writing to stdout
+fails(){
+    local name=$1
+    shift
+    if ! "$@" > got 2> /dev/null && [ ! -s got ]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+}
+
+# inputs: short runs of letters, no two neighbours alike, so every run is
+# under 255 and every encoding of the backlog agrees; then runs of up to 1000
+python3 - <<'PY'
+import random
+def runs(name, size, longest, seed):
+    r = random.Random(seed)
+    out, prev = bytearray(), None
+    while len(out) < size:
+        c = r.choice([x for x in b'abcdefgh' if x != prev])
+        out += bytes([c]) * r.randint(1, longest)
+        prev = c
+    open(name, 'wb').write(out[:size])
+runs('mixed', 3 << 20, 40, 1)
+runs('part1', 100000, 200, 2)
+runs('part2', 150001, 200, 3)
+runs('part3', 7, 3, 4)
+runs('long', 1 << 20, 1000, 5)
+PY
+
+printf 'aaabbbbc' > small
+printf 'a\003b\004c\001' > want
+"$bin" small > got
+same "encode aaabbbbc" want got
+printf 'aab' > small1
+printf 'bcc' > small2
+printf 'a\002b\002c\002' > want
+"$bin" small1 small2 > got
+same "encode aab bcc as one stream" want got
+
+"$tmp/nyuenc_base" mixed > want
+for j in 1 3 16; do
+    "$bin" -j $j mixed > got
+    same "encode mixed -j $j as the baseline does" want got
+done
+"$tmp/nyuenc_base" part1 part2 part3 part1 > want
+"$bin" -j 4 part1 part2 part3 part1 > got
+same "encode four files as the baseline does" want got
+# counts past 255 wrap in the legacy format, as they always have
+"$tmp/nyuenc_base" long > want
+"$bin" -j 2 long > got
+same "encode long runs as the baseline does" want got
+
+# -d: decoding reverses the legacy encoding, over one file or several
+printf 'a\003b\004c\001' > small.enc
+printf 'aaabbbbc' > want
+"$bin" -d small.enc > got
+same "decode a3 b4 c1" want got
+"$bin" mixed > mixed.enc
+for j in 1 4; do
+    "$bin" -d -j $j mixed.enc > got
+    same "decode mixed -j $j" mixed got
+done
+"$bin" part1 > part1.enc
+"$bin" part2 > part2.enc
+cat part1 part2 > want
+"$bin" -d part1.enc part2.enc > got
+same "decode two files into one stream" want got
+# stdout opened for append is written in order, not through a mapping
+printf 'kept' > want
+cat mixed >> want
+printf 'kept' > got
+"$bin" -d mixed.enc >> got
+same "decode onto the end of an existing file" want got
+"$bin" -F part1 > part1.nyf
+fails "reject -x over more than one file" "$bin" -d -x 0:10 part1.nyf part1.nyf
+
+# -F: framed files decode whole or by -x start:length; runs past 255 are split
+printf 'aaabbbbc' > small
+"$bin" -F small > small.nyf
+printf 'abb' > want
+"$bin" -d -x 2:3 small.nyf > got
+same "decode -x 2:3 of framed aaabbbbc" want got
+for f in mixed long; do
+    "$bin" -F -j 4 $f > $f.nyf
+    "$bin" -d $f.nyf > got
+    same "decode framed $f" $f got
+done
+# ranges inside one block, across block boundaries (blocks hold about 1 MB), and to the end
+for range in 0:1 12345:6789 1048000:2000 1000000:2100000 3145000:100000; do
+    start=${range%:*}
+    length=${range#*:}
+    tail -c +$((start + 1)) mixed | head -c $length > want
+    "$bin" -d -x $range mixed.nyf > got
+    same "decode -x $range of framed mixed" want got
+done
+# a legacy stream can start with the frame magic: 89 Ns, 70 Us and 3 zs encode to NYUFz\003
+printf 'NYUFz\003' > nyuf.enc
+python3 -c 'import sys; sys.stdout.write("N" * 89 + "U" * 70 + "zzz")' > want
+"$bin" -d nyuf.enc > got
+same "decode a legacy stream that starts with NYUF" want got
+
+# -C: the other codecs, whose blocks follow the 16-byte frame header
+python3 -c 'import sys; sys.stdout.write("a" * 300)' > small
+"$bin" -F -C vrle small > small.nyf
+printf 'a\254\002' > want
+tail -c +17 small.nyf | head -c 3 > got
+same "encode 300 as with vrle as a, LEB128(300)" want got
+printf 'aaabc' > small
+"$bin" -F -C packbits small > small.nyf
+printf '\376a\001bc' > want
+tail -c +17 small.nyf | head -c 5 > got
+same "encode aaabc with packbits as a run of 3, then 2 literals" want got
+for codec in vrle packbits; do
+    for f in mixed long; do
+        "$bin" -F -C $codec -j 4 $f > $f.$codec
+        "$bin" -d $f.$codec > got
+        same "decode $codec $f" $f got
+    done
+    tail -c +1000001 mixed | head -c 1500000 > want
+    "$bin" -d -x 1000000:1500000 mixed.$codec > got
+    same "decode -x 1000000:1500000 of $codec mixed" want got
+done
+# an index entry pointing past the index is refused before anything is written
+cp mixed.vrle bad.nyf
+python3 -c 'import os, sys; f = open(sys.argv[1], "r+b"); f.seek(os.path.getsize(sys.argv[1]) - 32 - 8); f.write(b"\xff" * 8)' bad.nyf
+fails "reject a framed file with a corrupt index" "$bin" -d bad.nyf
+
+# libnyuenc: a client fed in odd-sized pieces writes the plain stream nyuenc does,
+# and picks the rle kernel without being told to
+cat > client.c <<'C'
+#include <stdio.h>
+#include <string.h>
+#include "libnyuenc.h"
+#include "rle_scan.h"
+
+static void sink(void *ctx, const void *buf, size_t len){
+    fwrite(buf, 1, len, ctx);
+}
+
+//client [rle|vrle|packbits]: plain rle stream of stdin, or framed with that codec
+int main(int argc, char **argv){
+    NyuOptions opts = { .chunk_size = 4096, .framed = argc > 1, .codec = NYU_CODEC_RLE, .stats = 0 };
+    if (argc > 1 && strcmp(argv[1], "vrle") == 0){
+        opts.codec = NYU_CODEC_VRLE;
+    }else if (argc > 1 && strcmp(argv[1], "packbits") == 0){
+        opts.codec = NYU_CODEC_PACKBITS;
+    }
+    NyuPool *pool = nyu_pool_create(3, 0, 0);
+    NyuEncoder *enc = pool != NULL ? nyu_encoder_create(pool, &opts, sink, stdout) : NULL;
+    if (enc == NULL){
+        return 1;
+    }
+    fprintf(stderr, "%s\n", rle_scan_name());
+    static char buf[100003];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0){
+        if (nyu_encoder_feed(enc, buf, n) == -1){
+            return 1;
+        }
+    }
+    if (nyu_encoder_finish(enc) == -1){
+        return 1;
+    }
+    nyu_encoder_destroy(enc);
+    nyu_pool_destroy(pool);
+    return 0;
+}
+C
+gcc -O2 -std=gnu17 -Wall -Werror -Wextra -pedantic -I"$dir" -o client client.c "$dir/libnyuenc.a" -pthread || exit 1
+kernel=scalar
+for k in sse2 avx2; do
+    grep -qw $k /proc/cpuinfo && kernel=$k
+done
+echo $kernel > want
+./client < mixed > /dev/null 2> got
+same "libnyuenc picks the $kernel kernel on its own" want got
+"$bin" mixed > want
+./client < mixed > got 2> /dev/null
+same "libnyuenc encodes mixed as nyuenc does" want got
+# framed blocks start at chunk cuts, which follow the feeds: those are checked by decoding
+for codec in rle vrle packbits; do
+    ./client $codec < mixed > mixed.lib 2> /dev/null
+    "$bin" -d mixed.lib > got
+    same "decode libnyuenc framed $codec mixed" mixed got
+    tail -c +1000001 mixed | head -c 1500000 > want
+    "$bin" -d -x 1000000:1500000 mixed.lib > got
+    same "decode -x 1000000:1500000 of libnyuenc framed $codec mixed" want got
+done
+
+exit $failed
@@ -0,0 +1,138 @@
+#include <string.h>
+#include "codec.h"
+
+static void rle_put_run(CodecState *cs, char letter, uint64_t count, EmitFn emit, void *ctx){
+    (void) cs;
+    while (count > 0){
+        unsigned char pair[2] = {letter, count < 255 ? count : 255};
+        emit(ctx, pair, 2);
+        count -= pair[1];
+    }
+}
+
+static void no_flush(CodecState *cs, EmitFn emit, void *ctx){
+    (void) cs;
+    (void) emit;
+    (void) ctx;
+}
+
+static int rle_decode(const unsigned char *in, size_t len, const RunSink *sink){
+    if (len % 2 != 0){
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2){
+        sink->run(sink->ctx, in[i], in[i + 1]);
+    }
+    return 0;
+}
+
+static void vrle_put_run(CodecState *cs, char letter, uint64_t count, EmitFn emit, void *ctx){
+    (void) cs;
+    unsigned char buf[11];
+    size_t n = 0;
+    buf[n++] = letter;
+    do{
+        buf[n++] = (count & 0x7f) | (count > 0x7f ? 0x80 : 0);
+        count >>= 7;
+    }while (count > 0);
+    emit(ctx, buf, n);
+}
+
+static int vrle_decode(const unsigned char *in, size_t len, const RunSink *sink){
+    size_t i = 0;
+    while (i < len){
+        char letter = in[i++];
+        uint64_t count = 0;
+        int shift = 0;
+        while (1){
+            if (i == len || shift > 63){
+                return -1;
+            }
+            unsigned char b = in[i++];
+            count |= (uint64_t) (b & 0x7f) << shift;
+            shift += 7;
+            if (!(b & 0x80)){
+                break;
+            }
+        }
+        sink->run(sink->ctx, letter, count);
+    }
+    return 0;
+}
+
+static void packbits_flush(CodecState *cs, EmitFn emit, void *ctx){
+    if (cs->num_literal > 0){
+        unsigned char header = cs->num_literal - 1;
+        emit(ctx, &header, 1);
+        emit(ctx, cs->literal, cs->num_literal);
+        cs->num_literal = 0;
+    }
+}
+
+static void packbits_put_run(CodecState *cs, char letter, uint64_t count, EmitFn emit, void *ctx){
+    if (count < 3){ //too short to pay for a repeat packet, keep it literal
+        for (uint64_t i = 0; i < count; i++){
+            cs->literal[cs->num_literal++] = letter;
+            if (cs->num_literal == 128){
+                packbits_flush(cs, emit, ctx);
+            }
+        }
+        return;
+    }
+    packbits_flush(cs, emit, ctx);
+    while (count > 0){
+        uint64_t n = count < 128 ? count : 128;
+        if (n == 1){ //leftover after 128-byte packets
+            cs->literal[cs->num_literal++] = letter;
+            break;
+        }
+        unsigned char packet[2] = {257 - n, letter};
+        emit(ctx, packet, 2);
+        count -= n;
+    }
+}
+
+static int packbits_decode(const unsigned char *in, size_t len, const RunSink *sink){
+    size_t i = 0;
+    while (i < len){
+        unsigned char h = in[i++];
+        if (h < 128){
+            if (len - i < (size_t) h + 1){
+                return -1;
+            }
+            sink->literal(sink->ctx, (const char *) in + i, h + 1);
+            i += h + 1;
+        }else if (h > 128){
+            if (i == len){
+                return -1;
+            }
+            sink->run(sink->ctx, in[i++], 257 - h);
+        }
+    }
+    return 0;
+}
+
+static const Codec codecs[] = {
+    {"rle", CODEC_RLE, rle_put_run, no_flush, rle_decode},
+    {"vrle", CODEC_VRLE, vrle_put_run, no_flush, vrle_decode},
+    {"packbits", CODEC_PACKBITS, packbits_put_run, packbits_flush, packbits_decode},
+};
+#define NUM_CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+const Codec *codec_by_name(const char *name){
+    for (size_t i = 0; i < NUM_CODECS; i++){
+        if (strcmp(codecs[i].name, name) == 0){
+            return &codecs[i];
+        }
+    }
+    return NULL;
+}
+
+const Codec *codec_by_id(int id){
+    for (size_t i = 0; i < NUM_CODECS; i++){
+        if (codecs[i].id == id){
+            return &codecs[i];
+        }
+    }
+    return NULL;
+}
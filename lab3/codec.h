@@ -0,0 +1,43 @@
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Codecs for the framed (versioned) format, picked with -C and recorded in the
+    header's codec byte. Encoders are fed whole runs by the stitcher (runs are
+    already merged across chunk boundaries, with 64-bit lengths) and emit bytes
+    through an EmitFn; decoders report runs and literal strings to a RunSink.
+      rle       letter, count u8 (the original format, runs split at 255)
+      vrle      letter, run length as an LEB128 varint
+      packbits  PackBits: header h < 128 is followed by h + 1 literal bytes,
+                h > 128 by one byte repeated 257 - h times (2..128)
+*/
+enum{ CODEC_RLE = 0, CODEC_VRLE = 1, CODEC_PACKBITS = 2 };
+
+typedef void (*EmitFn)(void *ctx, const void *buf, size_t len);
+
+typedef struct{
+    void (*run)(void *ctx, char letter, uint64_t count);
+    void (*literal)(void *ctx, const char *bytes, size_t len);
+    void *ctx;
+} RunSink;
+
+typedef struct{
+    unsigned char literal[128]; //packbits: pending literal bytes
+    int num_literal;
+} CodecState;
+
+typedef struct{
+    const char *name;
+    int id;
+    void (*put_run)(CodecState *cs, char letter, uint64_t count, EmitFn emit, void *ctx);
+    void (*flush)(CodecState *cs, EmitFn emit, void *ctx); //end of block
+    int (*decode)(const unsigned char *in, size_t len, const RunSink *sink); //-1 if corrupt
+} Codec;
+
+const Codec *codec_by_name(const char *name);
+const Codec *codec_by_id(int id);
+
+#endif
@@ -0,0 +1,120 @@
+#include <string.h>
+#include "frame.h"
+
+static const char header_magic[4] = {'N', 'Y', 'U', 'F'};
+static const char trailer_magic[8] = {'N', 'Y', 'U', 'F', 'I', 'D', 'X', '\0'};
+
+static void put_u32(unsigned char *buf, uint32_t v){
+    for (int i = 0; i < 4; i++){
+        buf[i] = v >> (8 * i);
+    }
+}
+
+static void put_u64(unsigned char *buf, uint64_t v){
+    for (int i = 0; i < 8; i++){
+        buf[i] = v >> (8 * i);
+    }
+}
+
+static uint32_t get_u32(const unsigned char *buf){
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--){
+        v = v << 8 | buf[i];
+    }
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *buf){
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--){
+        v = v << 8 | buf[i];
+    }
+    return v;
+}
+
+void frame_put_header(unsigned char *buf, const FrameHeader *h){
+    memset(buf, 0, FRAME_HEADER_SIZE);
+    memcpy(buf, header_magic, 4);
+    buf[4] = h->version;
+    buf[5] = h->codec;
+    put_u32(buf + 8, h->block_size);
+}
+
+//returns 0 if buf starts with a framed header, -1 otherwise
+int frame_get_header(const unsigned char *buf, size_t len, FrameHeader *h){
+    if (len < FRAME_HEADER_SIZE || memcmp(buf, header_magic, 4) != 0){
+        return -1;
+    }
+    h->version = buf[4];
+    h->codec = buf[5];
+    h->block_size = get_u32(buf + 8);
+    return 0;
+}
+
+void frame_put_index_entry(unsigned char *buf, const FrameIndexEntry *e){
+    put_u64(buf, e->raw_offset);
+    put_u64(buf + 8, e->enc_offset);
+}
+
+void frame_get_index_entry(const unsigned char *buf, FrameIndexEntry *e){
+    e->raw_offset = get_u64(buf);
+    e->enc_offset = get_u64(buf + 8);
+}
+
+void frame_put_trailer(unsigned char *buf, const FrameTrailer *t){
+    put_u64(buf, t->index_offset);
+    put_u64(buf + 8, t->num_blocks);
+    put_u64(buf + 16, t->raw_size);
+    memcpy(buf + 24, trailer_magic, 8);
+}
+
+//reads the trailer at the end of a whole framed file, -1 if missing or inconsistent
+int frame_get_trailer(const unsigned char *file, size_t len, FrameTrailer *t){
+    if (len < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE){
+        return -1;
+    }
+    const unsigned char *buf = file + len - FRAME_TRAILER_SIZE;
+    if (memcmp(buf + 24, trailer_magic, 8) != 0){
+        return -1;
+    }
+    t->index_offset = get_u64(buf);
+    t->num_blocks = get_u64(buf + 8);
+    t->raw_size = get_u64(buf + 16);
+    if (t->index_offset < FRAME_HEADER_SIZE || t->index_offset > len - FRAME_TRAILER_SIZE
+            || (len - FRAME_TRAILER_SIZE - t->index_offset) / FRAME_INDEX_ENTRY_SIZE != t->num_blocks){
+        return -1;
+    }
+    return 0;
+}
+
+//checks that the blocks of a whole framed file (with a good trailer) lie in order between
+//the header and the index and cover raw offsets 0 to raw_size; -1 if they don't
+int frame_check_index(const unsigned char *file, const FrameTrailer *t){
+    FrameIndexEntry prev = { 0, FRAME_HEADER_SIZE };
+    for (uint64_t b = 0; b < t->num_blocks; b++){
+        FrameIndexEntry e;
+        frame_get_index_entry(file + t->index_offset + b * FRAME_INDEX_ENTRY_SIZE, &e);
+        if ((b == 0 && e.raw_offset != 0) || e.raw_offset < prev.raw_offset || e.raw_offset > t->raw_size
+                || e.enc_offset < prev.enc_offset || e.enc_offset > t->index_offset){
+            return -1;
+        }
+        prev = e;
+    }
+    return 0;
+}
+
+//index of the block holding raw_offset (binary search over the raw offsets)
+uint64_t frame_find_block(const unsigned char *index, uint64_t num_blocks, uint64_t raw_offset){
+    uint64_t lo = 0, hi = num_blocks;
+    while (hi - lo > 1){
+        uint64_t mid = lo + (hi - lo) / 2;
+        FrameIndexEntry e;
+        frame_get_index_entry(index + mid * FRAME_INDEX_ENTRY_SIZE, &e);
+        if (e.raw_offset <= raw_offset){
+            lo = mid;
+        }else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
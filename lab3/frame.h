@@ -0,0 +1,47 @@
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Framed (seekable) container, all integers little-endian:
+      header   "NYUF" | version u8 | codec u8 | reserved u16 | block_size u32 | reserved u32
+      blocks   independently decodable encoded streams, back to back
+      index    one entry per block: raw (uncompressed) offset u64 | encoded offset u64
+      trailer  index offset u64 | block count u64 | raw size u64 | "NYUFIDX\0"
+    Encoded offsets are from the start of the file. Blocks start on chunk
+    boundaries, so their raw sizes vary around block_size.
+*/
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 16
+#define FRAME_INDEX_ENTRY_SIZE 16
+#define FRAME_TRAILER_SIZE 32
+
+typedef struct{
+    int version;
+    int codec;
+    uint32_t block_size;
+} FrameHeader;
+
+typedef struct{
+    uint64_t raw_offset;
+    uint64_t enc_offset;
+} FrameIndexEntry;
+
+typedef struct{
+    uint64_t index_offset;
+    uint64_t num_blocks;
+    uint64_t raw_size;
+} FrameTrailer;
+
+void frame_put_header(unsigned char *buf, const FrameHeader *h);
+int frame_get_header(const unsigned char *buf, size_t len, FrameHeader *h);
+void frame_put_index_entry(unsigned char *buf, const FrameIndexEntry *e);
+void frame_get_index_entry(const unsigned char *buf, FrameIndexEntry *e);
+void frame_put_trailer(unsigned char *buf, const FrameTrailer *t);
+int frame_get_trailer(const unsigned char *file, size_t len, FrameTrailer *t);
+int frame_check_index(const unsigned char *file, const FrameTrailer *t);
+uint64_t frame_find_block(const unsigned char *index, uint64_t num_blocks, uint64_t raw_offset);
+
+#endif
@@ -0,0 +1,635 @@
+#define _GNU_SOURCE //MADV_HUGEPAGE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "libnyuenc.h"
+#include "pool.h"
+#include "rle_scan.h"
+#include "frame.h"
+#include "codec.h"
+
+_Static_assert((int) NYU_CODEC_RLE == CODEC_RLE && (int) NYU_CODEC_VRLE == CODEC_VRLE &&
+        (int) NYU_CODEC_PACKBITS == CODEC_PACKBITS, "libnyuenc.h and codec.h disagree on the codec ids");
+
+typedef struct{
+    int num_pairs;
+    Pair *pairs; //compressed data, points into the slot's arena buffer
+    int raw_size; //input bytes the chunk covers
+} Chunk;
+
+/*
+    Output stage: pairs are appended to a large buffer that is handed to the
+    sink once it fills up, instead of one call per pair.
+*/
+#define OUT_BUF_SIZE (1 << 20)
+
+typedef struct{
+    NyuSink sink;
+    void *ctx;
+    size_t len;
+    uint64_t flushed; //bytes already handed to the sink
+    char *buf;
+} Output;
+
+static void out_flush(Output *w){
+    if (w->len > 0){
+        w->sink(w->ctx, w->buf, w->len);
+    }
+    w->flushed += w->len;
+    w->len = 0;
+}
+
+//offset of the next byte in the output stream
+static inline uint64_t out_tell(Output *w){
+    return w->flushed + w->len;
+}
+
+static void out_put_bytes(Output *w, const void *data, size_t len){
+    if (w->len + len > OUT_BUF_SIZE){
+        out_flush(w);
+    }
+    memcpy(w->buf + w->len, data, len); //callers write headers, index entries and codec packets, all small
+    w->len += len;
+}
+
+static inline void out_put_pair(Output *w, char letter, unsigned char count){
+    if (w->len + 2 > OUT_BUF_SIZE){
+        out_flush(w);
+    }
+    w->buf[w->len++] = letter;
+    w->buf[w->len++] = (char) count;
+}
+
+static void out_emit(void *ctx, const void *buf, size_t len){
+    out_put_bytes(ctx, buf, len);
+}
+
+/*
+    Framed output (-F, implied by -C): the stream is cut into blocks of about
+    FRAME_BLOCK_SIZE input bytes. A block starts at the first chunk boundary past
+    the nominal size and never continues a run from the previous block, so each
+    one decodes on its own; the index written at the end maps raw offsets to
+    block offsets. Runs are merged across chunks with 64-bit lengths and handed
+    whole to the codec, so counts never wrap.
+*/
+#define FRAME_BLOCK_SIZE (1 << 20)
+
+//stitching state carried across chunks: a run may continue into the next chunk
+typedef struct{
+    char last_letter;
+    unsigned char last_sum;
+    int begin_chunk; //keeping track of beginning of the chunk entry
+    int framed;
+    const Codec *codec; //framed only
+    CodecState cs;
+    uint64_t run; //framed: length of the pending run
+    uint64_t raw_pos; //input bytes stitched so far
+    uint64_t next_block; //raw offset at which the next block may start
+    uint64_t fed; //input bytes dispatched so far, bounds the number of blocks
+    FrameIndexEntry *index;
+    size_t num_blocks, index_cap;
+} Stitcher;
+
+//framed: hand the pending run to the codec and close the codec's packet
+static void stitch_end_block(Stitcher *st, Output *out){
+    if (st->begin_chunk != 1){
+        st->codec->put_run(&st->cs, st->last_letter, st->run, out_emit, out);
+        st->begin_chunk = 1;
+    }
+    st->codec->flush(&st->cs, out_emit, out);
+}
+
+//framed: make room in the index for every block the first fed bytes can start, so
+//stitching never allocates; -1 if out of memory
+static int stitch_reserve(Stitcher *st, uint64_t fed){
+    //a block starts at the first chunk at or past FRAME_BLOCK_SIZE from the previous one
+    size_t blocks = fed / FRAME_BLOCK_SIZE + 1;
+    if (!st->framed || blocks <= st->index_cap){
+        return 0;
+    }
+    size_t cap = st->index_cap ? st->index_cap : 64;
+    while (cap < blocks){
+        cap *= 2;
+    }
+    FrameIndexEntry *index = realloc(st->index, cap * sizeof(FrameIndexEntry));
+    if (index == NULL){
+        return -1;
+    }
+    st->index = index;
+    st->index_cap = cap;
+    return 0;
+}
+
+static void stitch_begin_block(Stitcher *st, Output *out){
+    stitch_end_block(st, out); //the index has room: dispatch reserved it
+    st->index[st->num_blocks].raw_offset = st->raw_pos;
+    st->index[st->num_blocks].enc_offset = out_tell(out);
+    st->num_blocks++;
+    st->next_block = st->raw_pos + FRAME_BLOCK_SIZE;
+}
+
+static void stitch_chunk(Stitcher *st, Chunk *chunk, Output *out){
+    Pair *pairs = chunk->pairs;
+
+    if (st->framed){
+        if (st->raw_pos >= st->next_block){
+            stitch_begin_block(st, out);
+        }
+        for (int i = 0; i < chunk->num_pairs; i++){
+            if (st->last_letter == pairs[i].letter && st->begin_chunk != 1){
+                st->run += pairs[i].count;
+            }else{
+                if (st->begin_chunk != 1){
+                    st->codec->put_run(&st->cs, st->last_letter, st->run, out_emit, out);
+                }
+                st->last_letter = pairs[i].letter;
+                st->run = pairs[i].count;
+            }
+            st->begin_chunk = 0;
+        }
+        st->raw_pos += chunk->raw_size;
+        return;
+    }
+
+    for (int i = 0; i < chunk->num_pairs; i++){
+        char current_char = pairs[i].letter;
+        unsigned char current_sum = pairs[i].count;
+
+        if (st->last_letter == current_char && st->begin_chunk != 1){
+            st->last_sum = st->last_sum + current_sum;
+        }else{
+            if (st->begin_chunk != 1){
+                out_put_pair(out, st->last_letter, st->last_sum);
+            }
+            //update last letter and sum
+            st->last_letter = current_char;
+            st->last_sum = current_sum;
+        }
+        st->begin_chunk = 0;
+    }
+    st->raw_pos += chunk->raw_size;
+}
+
+static void stitch_start(Stitcher *st, Output *out){
+    if (st->framed){
+        unsigned char header[FRAME_HEADER_SIZE];
+        FrameHeader h = { .version = FRAME_VERSION, .codec = st->codec->id, .block_size = FRAME_BLOCK_SIZE };
+        frame_put_header(header, &h);
+        out_put_bytes(out, header, sizeof(header));
+    }
+}
+
+//write the pending run (and the index when framed) and drain the buffer
+static void stitch_finish(Stitcher *st, Output *out){
+    if (!st->framed){
+        out_put_pair(out, st->last_letter, st->last_sum);
+        out_flush(out);
+        return;
+    }
+    stitch_end_block(st, out);
+    FrameTrailer t = {
+        .index_offset = out_tell(out),
+        .num_blocks = st->num_blocks,
+        .raw_size = st->raw_pos
+    };
+    unsigned char buf[FRAME_TRAILER_SIZE];
+    for (size_t i = 0; i < st->num_blocks; i++){
+        frame_put_index_entry(buf, &st->index[i]);
+        out_put_bytes(out, buf, FRAME_INDEX_ENTRY_SIZE);
+    }
+    frame_put_trailer(buf, &t);
+    out_put_bytes(out, buf, FRAME_TRAILER_SIZE);
+    out_flush(out);
+    free(st->index);
+}
+
+//a fed buffer waiting for its chunks to be stitched
+typedef struct ref{
+    size_t end_id; //id after the last chunk cut from it
+    void (*release)(void *arg);
+    void *arg;
+    struct ref *next;
+} Ref;
+
+//nyu_encoder_feed copies into stage buffers of STAGE_CHUNKS chunks, recycled once stitched
+#define STAGE_CHUNKS 16
+
+typedef struct stage{
+    struct stage *next; //free list
+    NyuEncoder *enc;
+    char data[];
+} Stage;
+
+/*
+    Reorder window: chunk id k lives in slot k % window_slots until the stitcher
+    has written it out. The encoder never cuts task k before chunk
+    k - window_slots has been stitched, so memory stays bounded however large
+    the input is. The window covers about WINDOW_BYTES of input, but always
+    has room for two chunks per worker.
+
+    Completion ring: the worker that encodes chunk id stores it in its slot, then
+    publishes id + 1 in the slot's sequence word (release). The stitcher knows
+    which id it needs next, so a slot is complete once its sequence matches,
+    with no lock shared between workers and stitcher. When the next chunk is
+    missing the stitcher spins for a while, then announces the sequence it waits
+    for in parked and sleeps on the slot's word with a futex; only a worker
+    that publishes exactly that sequence makes the wake-up syscall.
+    Sequences are 32 bits (futex words); a slot only ever holds id or
+    id - window_slots, so wrap-around cannot confuse them. Ids keep counting
+    across streams for the same reason.
+
+    Every window slot owns a fixed buffer of chunk_size + chunk_slack pairs (a
+    chunk can never produce more pairs than bytes), carved from one arena when
+    the encoder is created. Releasing the slot in the stitcher returns the
+    buffer, so encoding does no malloc/free.
+*/
+#define WINDOW_BYTES (64 << 20)
+#define MAX_WINDOW_SLOTS 1024
+#define STITCH_SPIN 4096
+
+struct encoder{
+    Pool *pool;
+    size_t chunk_size;
+    size_t chunk_slack; //a chunk may grow by up to this much to end on a run boundary
+
+    size_t window_slots; //power of two
+    Chunk *chunks;
+    _Atomic uint32_t *done_seq; //per slot: id + 1 of the last chunk published there
+    _Atomic uint32_t parked; //sequence the stitcher sleeps on, 0 if awake
+    int spin; //STITCH_SPIN, or 0 on a single CPU where spinning only delays the worker
+    Pair *slot_arena;
+    size_t slot_pairs;
+
+    size_t next_id; //id of the next task to cut
+    size_t stitched; //id of the next chunk to write
+    int framed;
+    const Codec *codec;
+    Stitcher st;
+    int started; //stream header written
+    Output out;
+
+    Ref *refs, *refs_tail;
+    Stage *stage; //being filled by feed
+    size_t stage_len, stage_size;
+    Stage *free_stages;
+
+    Stats stats;
+    int timed; //opts->stats
+};
+
+#define SLOT(enc, id) ((id) & ((enc)->window_slots - 1))
+
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void publish_chunk(NyuEncoder *enc, size_t id, Chunk chunk){
+    size_t index = SLOT(enc, id);
+    uint32_t seq = (uint32_t) (id + 1);
+    enc->chunks[index] = chunk;
+    atomic_store(&enc->done_seq[index], seq);
+    //seq_cst store then load pairs with the stitcher's store to parked then recheck
+    if (atomic_load(&enc->parked) == seq){
+        syscall(SYS_futex, &enc->done_seq[index], FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static inline int chunk_done(NyuEncoder *enc, size_t id){
+    return atomic_load_explicit(&enc->done_seq[SLOT(enc, id)], memory_order_acquire) == (uint32_t) (id + 1);
+}
+
+//block until chunk id is published
+static void wait_chunk(NyuEncoder *enc, size_t id){
+    _Atomic uint32_t *word = &enc->done_seq[SLOT(enc, id)];
+    uint32_t seq = (uint32_t) (id + 1);
+    for (int i = 0; i < enc->spin; i++){
+        if (chunk_done(enc, id)){
+            return;
+        }
+        cpu_relax();
+    }
+    while (1){
+        atomic_store(&enc->parked, seq);
+        uint32_t current = atomic_load(word);
+        if (current == seq){
+            break;
+        }
+        //returns at once if the word is no longer current (published meanwhile)
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, current, NULL, NULL, 0);
+    }
+    atomic_store_explicit(&enc->parked, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+}
+
+static inline Pair *slot_buffer(NyuEncoder *enc, size_t id){
+    return enc->slot_arena + SLOT(enc, id) * enc->slot_pairs;
+}
+
+static void encode_task(Task *task){
+    NyuEncoder *enc = task->ctx;
+
+    Pair *pairs = slot_buffer(enc, task->id); //free: the encoder only cuts tasks for released slots
+    Chunk chunk = {
+        .num_pairs = rle_encode(task->data, task->size, pairs),
+        .pairs = pairs,
+        .raw_size = task->size
+    };
+
+    publish_chunk(enc, task->id, chunk);
+}
+
+//length of the next chunk: chunk_size, stretched to the end of a run that straddles the cut
+static size_t cut_chunk(NyuEncoder *enc, const char *data, size_t remaining){
+    size_t chunk_size = enc->chunk_size, chunk_slack = enc->chunk_slack;
+    if (remaining <= chunk_size){
+        return remaining;
+    }
+    size_t limit = remaining - chunk_size + 1 < chunk_slack + 1 ? remaining - chunk_size + 1 : chunk_slack + 1;
+    size_t tail = run_length((const unsigned char *) data + chunk_size - 1, limit) - 1;
+    if (tail < chunk_slack){
+        return chunk_size + tail;
+    }
+    return chunk_size; //run continues past the slack, the stitcher joins it
+}
+
+//wait for chunk id, write it out, recycle its slot and release buffers it finished
+static void stitch_next(NyuEncoder *enc){
+    size_t id = enc->stitched++;
+    if (enc->timed && !chunk_done(enc, id)){
+        uint64_t start = stats_now();
+        wait_chunk(enc, id);
+        enc->stats.stall_ns += stats_now() - start;
+        enc->stats.stalls++;
+    }
+    wait_chunk(enc, id);
+    uint64_t start = stats_clock(enc->timed);
+    stitch_chunk(&enc->st, &enc->chunks[SLOT(enc, id)], &enc->out);
+    if (enc->timed){
+        enc->stats.stitch_ns += stats_now() - start;
+        enc->stats.chunks++;
+    }
+
+    while (enc->refs != NULL && enc->refs->end_id <= id + 1){
+        Ref *done = enc->refs;
+        enc->refs = done->next;
+        if (enc->refs == NULL){
+            enc->refs_tail = NULL;
+        }
+        done->release(done->arg);
+        free(done);
+    }
+}
+
+static void start_stream(NyuEncoder *enc){
+    if (!enc->started){
+        enc->st = (Stitcher){ .last_letter = 0, .last_sum = 0, .begin_chunk = 1, .framed = enc->framed, .codec = enc->codec };
+        stitch_start(&enc->st, &enc->out);
+        enc->started = 1;
+    }
+}
+
+//cut buf into tasks; release(arg) once all of them are stitched. -1 if out of memory,
+//before any of buf is taken
+static int dispatch(NyuEncoder *enc, const char *buf, size_t len, void (*release)(void *arg), void *arg){
+    start_stream(enc);
+    Ref *ref = malloc(sizeof(Ref));
+    if (ref == NULL || stitch_reserve(&enc->st, enc->st.fed + len) == -1){
+        free(ref);
+        return -1;
+    }
+    enc->st.fed += len;
+    enc->stats.bytes_in += len;
+
+    //create TASKS, split into chunk_size chunks
+    size_t offset = 0;
+    while (offset < len){
+        uint64_t start = stats_clock(enc->timed);
+        size_t size = cut_chunk(enc, buf + offset, len - offset);
+
+        Task task ={
+            .run = encode_task,
+            .ctx = enc,
+            .id = enc->next_id,
+            .size = size,
+            .data = (char *) buf + offset
+        };
+        offset += size;
+        if (enc->timed){
+            enc->stats.cut_ns += stats_now() - start;
+        }
+
+        //window full: write out finished chunks before cutting more
+        while (enc->next_id - enc->stitched >= enc->window_slots){
+            stitch_next(enc);
+        }
+        enc->next_id++;
+
+        start = stats_clock(enc->timed);
+        pool_submit(enc->pool, SLOT(enc, task.id), task);
+        if (enc->timed && enc->pool->num_workers > 0){
+            enc->stats.queue_full_ns += stats_now() - start;
+        }
+
+        //start output as soon as the oldest chunks are done
+        while (enc->stitched < enc->next_id && chunk_done(enc, enc->stitched)){
+            stitch_next(enc);
+        }
+    }
+
+    if (enc->stitched == enc->next_id){ //nothing in flight (empty buffer, or -j 0)
+        free(ref);
+        release(arg);
+        return 0;
+    }
+    *ref = (Ref){ .end_id = enc->next_id, .release = release, .arg = arg, .next = NULL };
+    if (enc->refs_tail == NULL){
+        enc->refs = ref;
+    }else{
+        enc->refs_tail->next = ref;
+    }
+    enc->refs_tail = ref;
+    return 0;
+}
+
+static void release_stage(void *arg){
+    Stage *stage = arg;
+    stage->next = stage->enc->free_stages;
+    stage->enc->free_stages = stage;
+}
+
+//-1 if out of memory, the stage is then kept for the next attempt
+static int dispatch_stage(NyuEncoder *enc){
+    if (enc->stage == NULL){
+        return 0;
+    }
+    Stage *stage = enc->stage;
+    enc->stage = NULL;
+    if (dispatch(enc, stage->data, enc->stage_len, release_stage, stage) == -1){
+        enc->stage = stage;
+        return -1;
+    }
+    return 0;
+}
+
+//the widest rle kernel the CPU runs, picked once for every pool and encoder
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+NyuPool *nyu_pool_create(int num_threads, int affinity, int stats){
+    pthread_once(&scan_once, rle_scan_init);
+    return pool_create(num_threads > 0 ? num_threads : 0, affinity, stats);
+}
+
+void nyu_pool_destroy(NyuPool *pool){
+    pool_destroy(pool);
+}
+
+NyuEncoder *nyu_encoder_create(NyuPool *pool, const NyuOptions *opts, NyuSink sink, void *ctx){
+    pthread_once(&scan_once, rle_scan_init);
+    NyuOptions defaults = { .chunk_size = 0, .framed = 0, .codec = NYU_CODEC_RLE, .stats = 0 };
+    if (opts == NULL){
+        opts = &defaults;
+    }
+    const Codec *codec = codec_by_id(opts->codec);
+    if (codec == NULL || (codec->id != CODEC_RLE && !opts->framed)){
+        return NULL;
+    }
+    NyuEncoder *enc = calloc(1, sizeof(NyuEncoder));
+    if (enc == NULL){
+        return NULL;
+    }
+    enc->pool = pool;
+    enc->framed = opts->framed;
+    enc->codec = codec;
+    enc->timed = opts->stats;
+    enc->chunk_size = opts->chunk_size ? opts->chunk_size : NYU_DEFAULT_CHUNK_SIZE;
+    enc->chunk_slack = enc->chunk_size / 16;
+    enc->stage_size = enc->chunk_size * STAGE_CHUNKS;
+    enc->out = (Output){ .sink = sink, .ctx = ctx, .len = 0, .flushed = 0, .buf = malloc(OUT_BUF_SIZE) };
+
+    size_t min_slots = 2 * (size_t) pool->num_workers + 2;
+    enc->window_slots = 1;
+    while (enc->window_slots < MAX_WINDOW_SLOTS &&
+            (enc->window_slots < min_slots || enc->window_slots * 2 * enc->chunk_size <= WINDOW_BYTES)){
+        enc->window_slots *= 2;
+    }
+    enc->chunks = calloc(enc->window_slots, sizeof(Chunk));
+    enc->done_seq = calloc(enc->window_slots, sizeof(*enc->done_seq));
+    enc->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? STITCH_SPIN : 0;
+
+    size_t page_pairs = sysconf(_SC_PAGESIZE) / sizeof(Pair);
+    enc->slot_pairs = (enc->chunk_size + enc->chunk_slack + page_pairs - 1) / page_pairs * page_pairs; //slots start on pages
+    size_t bytes = enc->window_slots * enc->slot_pairs * sizeof(Pair);
+    //anonymous mapping: pages are only backed once a worker writes them
+    enc->slot_arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (enc->out.buf == NULL || enc->chunks == NULL || enc->done_seq == NULL || enc->slot_arena == MAP_FAILED){
+        if (enc->slot_arena != MAP_FAILED){
+            munmap(enc->slot_arena, bytes);
+        }
+        free(enc->out.buf);
+        free(enc->chunks);
+        free((void *) enc->done_seq);
+        free(enc);
+        return NULL;
+    }
+    if (pool->affinity){
+        madvise(enc->slot_arena, bytes, MADV_HUGEPAGE);
+    }
+    for (size_t slot = 0; slot < enc->window_slots; slot++){
+        //slot s is always encoded by group s % num_groups: keep its buffer on that node
+        pool_bind(pool, enc->slot_arena + slot * enc->slot_pairs, enc->slot_pairs * sizeof(Pair), slot);
+    }
+    return enc;
+}
+
+int nyu_encoder_feed(NyuEncoder *enc, const void *buf, size_t len){
+    const char *p = buf;
+    while (len > 0){
+        //a full stage is left behind when dispatching it ran out of memory
+        if (enc->stage != NULL && enc->stage_len == enc->stage_size && dispatch_stage(enc) == -1){
+            return -1;
+        }
+        if (enc->stage == NULL){
+            enc->stage = enc->free_stages;
+            if (enc->stage != NULL){
+                enc->free_stages = enc->stage->next;
+            }else{
+                enc->stage = malloc(sizeof(Stage) + enc->stage_size);
+                if (enc->stage == NULL){
+                    return -1;
+                }
+                enc->stage->enc = enc;
+            }
+            enc->stage_len = 0;
+        }
+        size_t n = enc->stage_size - enc->stage_len < len ? enc->stage_size - enc->stage_len : len;
+        memcpy(enc->stage->data + enc->stage_len, p, n);
+        enc->stage_len += n;
+        p += n;
+        len -= n;
+        if (enc->stage_len == enc->stage_size && dispatch_stage(enc) == -1){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int nyu_encoder_feed_ref(NyuEncoder *enc, const void *buf, size_t len, void (*release)(void *arg), void *arg){
+    if (dispatch_stage(enc) == -1){ //copied bytes come first
+        return -1;
+    }
+    return dispatch(enc, buf, len, release, arg);
+}
+
+int nyu_encoder_finish(NyuEncoder *enc){
+    int ret = dispatch_stage(enc);
+    if (ret == -1){
+        //the staged bytes are dropped, everything dispatched before them is still written
+        release_stage(enc->stage);
+        enc->stage = NULL;
+    }
+    start_stream(enc); //empty stream: still a valid (header only) encoding
+
+    //Stitch and Write the remaining RESULTS
+    while (enc->stitched < enc->next_id){
+        stitch_next(enc);
+    }
+    stitch_finish(&enc->st, &enc->out);
+    enc->stats.bytes_out += out_tell(&enc->out);
+    enc->out.flushed = 0; //frame offsets are relative to the start of each stream
+    enc->started = 0;
+    return ret;
+}
+
+void nyu_encoder_destroy(NyuEncoder *enc){
+    if (enc->stage != NULL){
+        release_stage(enc->stage);
+    }
+    while (enc->free_stages != NULL){
+        Stage *stage = enc->free_stages;
+        enc->free_stages = stage->next;
+        free(stage);
+    }
+    if (enc->started){
+        free(enc->st.index); //a stream that was never finished
+    }
+    munmap(enc->slot_arena, enc->window_slots * enc->slot_pairs * sizeof(Pair));
+    free(enc->chunks);
+    free((void *) enc->done_seq);
+    free(enc->out.buf);
+    free(enc);
+}
+
+const Stats *nyu_encoder_stats(NyuEncoder *enc){
+    enc->stats.num_workers = enc->pool->num_workers;
+    enc->stats.workers = enc->pool->workers;
+    return &enc->stats;
+}
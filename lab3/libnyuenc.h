@@ -0,0 +1,75 @@
+#ifndef _LIBNYUENC_H_
+#define _LIBNYUENC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats.h"
+
+/*
+    libnyuenc: the nyuenc encoder as a library.
+
+    A pool owns the worker threads and can be kept warm across any number of
+    encoders, used one after the other or at the same time. An encoder turns a
+    stream fed in pieces into one encoded stream (the same bytes nyuenc writes
+    for the concatenated input) and hands the output to a sink callback in
+    large blocks, on the thread that calls feed/finish.
+
+        NyuPool *pool = nyu_pool_create(8, 0, 0);
+        NyuEncoder *enc = nyu_encoder_create(pool, NULL, sink, ctx);
+        nyu_encoder_feed(enc, buf, len); //any number of times
+        nyu_encoder_finish(enc); //end of stream, enc can start the next one
+        nyu_encoder_destroy(enc);
+        nyu_pool_destroy(pool);
+
+    An encoder must only be used from one thread at a time. The first pool or
+    encoder created picks the widest rle kernel the CPU supports (AVX2, SSE2 or
+    scalar) for the whole process.
+*/
+typedef struct pool NyuPool;
+typedef struct encoder NyuEncoder;
+
+typedef void (*NyuSink)(void *ctx, const void *buf, size_t len);
+
+#define NYU_DEFAULT_CHUNK_SIZE (256 << 10)
+
+//NyuOptions.codec: how a framed stream stores its runs (the ids in the frame header)
+enum{
+    NYU_CODEC_RLE = 0, //letter, count pairs; runs past 255 are split
+    NYU_CODEC_VRLE = 1, //letter, LEB128 count
+    NYU_CODEC_PACKBITS = 2 //PackBits: literal stretches and runs
+};
+
+typedef struct{
+    size_t chunk_size; //input bytes per task, 0: NYU_DEFAULT_CHUNK_SIZE
+    int framed; //seekable framed container instead of the plain pair stream
+    int codec; //NYU_CODEC_* id, framed only
+    int stats; //time the stages for nyu_encoder_stats (byte counts are always kept)
+} NyuOptions;
+
+//num_threads 0 runs every task on the calling thread, stats times the workers for
+//nyu_encoder_stats; NULL (errno set) if out of memory or a thread cannot be started
+NyuPool *nyu_pool_create(int num_threads, int affinity, int stats);
+void nyu_pool_destroy(NyuPool *pool); //every encoder using it must be finished
+
+//opts NULL: defaults (plain rle stream); NULL if out of memory or invalid options
+NyuEncoder *nyu_encoder_create(NyuPool *pool, const NyuOptions *opts, NyuSink sink, void *ctx);
+
+//copy len bytes into the stream; 0 on success, -1 if out of memory, when only
+//part of buf may have been taken: the stream is incomplete, but finish and
+//destroy are still safe
+int nyu_encoder_feed(NyuEncoder *enc, const void *buf, size_t len);
+
+//zero copy: buf must stay valid until release(arg) is called, which happens
+//on the caller's thread once every chunk of buf has been written to the sink;
+//0 on success, -1 if out of memory, when buf was not taken and release is not called
+int nyu_encoder_feed_ref(NyuEncoder *enc, const void *buf, size_t len, void (*release)(void *arg), void *arg);
+
+//end of stream: write out everything (and the frame index), then reset for the next stream;
+//-1 if out of memory, when bytes still staged by nyu_encoder_feed were dropped
+int nyu_encoder_finish(NyuEncoder *enc);
+void nyu_encoder_destroy(NyuEncoder *enc);
+
+//byte counts since the encoder was created, and stage timings if opts->stats was set
+const Stats *nyu_encoder_stats(NyuEncoder *enc);
+
+#endif
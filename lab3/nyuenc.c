@@ -1,15 +1,27 @@
+#define _GNU_SOURCE //O_DIRECT
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <pthread.h>
+#include <getopt.h>
+#include <semaphore.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include "rle_scan.h"
+#include "frame.h"
+#include "uring.h"
+#include "codec.h"
+#include "stats.h"
+#include "pool.h"
+#include "libnyuenc.h"
 
-#define CHUNK_SIZE 4096
-#define MAX_FILES 100
 
 /*
     References:
@@ -19,172 +31,1141 @@
     -Very helpful video on Thread Pools: https://www.youtube.com/watch?v=_n2hE2gyPxU
 */
 
-//synchronization
-pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t chunk_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
+/*
+    Chunk sizing: -c takes a size in bytes (K/M suffixes allowed), rounded up to
+    a page multiple. Without it (or with -c auto) the size is picked from the
+    total input size and job count so every worker gets about TASKS_PER_WORKER
+    chunks: small inputs still spread over all workers, large inputs do not
+    pay queue and stitch overhead per 4 KB. Auto sizes are powers of two from
+    the page size up to MAX_AUTO_CHUNK_SIZE; chunks are cut from the input
+    mapping as they fall, with no alignment beyond the page.
+*/
+#define MAX_CHUNK_SIZE (16 << 20)
+#define MAX_AUTO_CHUNK_SIZE (1 << 20)
+#define TASKS_PER_WORKER 16
+
+size_t chunk_size = 0; //0: auto
+
+size_t parse_chunk_size(const char *arg){
+    if (strcmp(arg, "auto") == 0){
+        return 0;
+    }
+    char *end;
+    unsigned long long size = strtoull(arg, &end, 10);
+    if (*end == 'k' || *end == 'K'){
+        size <<= 10;
+        end++;
+    }else if (*end == 'm' || *end == 'M'){
+        size <<= 20;
+        end++;
+    }
+    if (end == arg || *end != '\0' || size == 0 || size > MAX_CHUNK_SIZE){
+        fprintf(stderr, "Invalid chunk size %s (1 to %d bytes, or auto)\n", arg, MAX_CHUNK_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+size_t auto_chunk_size(off_t total_size, int num_jobs){
+    size_t target = total_size / ((num_jobs > 0 ? num_jobs : 1) * TASKS_PER_WORKER);
+    size_t size = sysconf(_SC_PAGESIZE);
+    while (size * 2 <= target && size * 2 <= MAX_AUTO_CHUNK_SIZE){
+        size *= 2;
+    }
+    return size;
+}
+
+/*
+    Decoder output: bytes are appended to a large buffer that is handed to
+    write(2) once it fills up. (The encoder buffers its own output, see
+    libnyuenc.c.)
+*/
+#define OUT_BUF_SIZE (1 << 20)
 
 typedef struct{
-    int size;
-    char *result; //compressed data
-    unsigned char* counts;
-} Chunk;
+    int fd;
+    size_t len;
+    uint64_t flushed; //bytes already handed to write(2)
+    char buf[OUT_BUF_SIZE];
+} Writer;
+
+void writer_flush(Writer *w){
+    size_t written = 0;
+    while (written < w->len){
+        ssize_t n = write(w->fd, w->buf + written, w->len - written);
+        if (n == -1){
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        written += n;
+    }
+    w->flushed += w->len;
+    w->len = 0;
+}
+
+//offset of the next byte in the output stream
+static inline uint64_t writer_tell(Writer *w){
+    return w->flushed + w->len;
+}
+
+void writer_put_bytes(Writer *w, const void *data, size_t len){
+    if (w->len + len > OUT_BUF_SIZE){
+        writer_flush(w);
+    }
+    memcpy(w->buf + w->len, data, len); //callers write headers, index entries and codec packets, all small
+    w->len += len;
+}
+
+/*
+    Input is loaded MAP_WINDOW bytes at a time and fed to the encoder without
+    copying. Segments are unmapped as soon as the encoder has written the last
+    chunk cut from them (it calls release_segment).
+
+    Input backends (-I), each one starts loading segment n+1 before chunks of
+    segment n are cut, so reads run ahead of the workers:
+      mmap      map the file, MADV_SEQUENTIAL + MADV_WILLNEED readahead (default)
+      populate  posix_fadvise WILLNEED ahead, then mmap with MAP_POPULATE so
+                workers never take page faults
+      pread     posix_fadvise WILLNEED ahead, then pread into an anonymous buffer
+      direct    pread with O_DIRECT, bypassing the page cache
+      uring     io_uring reads of URING_READ_SIZE in flight for the next segment,
+                O_DIRECT when the file system allows it
+*/
+#define MAP_WINDOW (64 << 20) //rounded up to a multiple of chunk_size, so always page aligned
+size_t map_window;
+#define URING_READ_SIZE (1 << 20)
+#define URING_ENTRIES 128
+#define URING_PIECE_SHIFT 48 //user space pointers fit in the low 48 bits
+#define URING_PTR_MASK ((UINT64_C(1) << URING_PIECE_SHIFT) - 1)
+
+typedef enum{ INPUT_MMAP, INPUT_POPULATE, INPUT_PREAD, INPUT_DIRECT, INPUT_URING } InputBackend;
+const char *input_backend_names[] = {"mmap", "populate", "pread", "direct", "uring"};
+InputBackend input_backend = INPUT_MMAP;
+Uring ring;
+
+typedef struct segment{
+    char *addr;
+    size_t len;
+    size_t map_len; //len rounded up to whole pages for anonymous buffers
+    int fd;
+    off_t offset;
+    int close_fd; //last segment of its file: close fd once loaded
+    int inflight; //uring: reads not completed yet
+} Segment;
+
+Pool *pool; //workers, also used for buffer placement
+Stats stats; //--stats of this run
+int stats_enabled = 0; //--stats
+
+InputBackend parse_input_backend(const char *arg){
+    for (size_t i = 0; i < sizeof(input_backend_names) / sizeof(input_backend_names[0]); i++){
+        if (strcmp(arg, input_backend_names[i]) == 0){
+            return i;
+        }
+    }
+    fprintf(stderr, "Invalid input backend %s (mmap, populate, pread, direct, uring)\n", arg);
+    exit(EXIT_FAILURE);
+}
+
+int open_input(const char *file_name){
+    int fd = -1;
+    if (input_backend == INPUT_DIRECT || input_backend == INPUT_URING){
+        fd = open(file_name, O_RDONLY | O_DIRECT);
+    }
+    if (fd == -1){ //O_DIRECT is not supported everywhere (tmpfs, some network file systems)
+        fd = open(file_name, O_RDONLY);
+    }
+    if (fd != -1){
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return fd;
+}
+
+//returns bytes read, short only at end of file
+size_t read_fully(int fd, char *buf, size_t len, off_t offset){
+    size_t done = 0;
+    while (done < len){
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n == -1){
+            if (errno == EINTR) continue;
+            perror("pread");
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0){
+            break; //file shrank underneath us
+        }
+        done += n;
+    }
+    return done;
+}
+
+void uring_complete(int wait){
+    if (uring_submit(&ring, wait) < 0){
+        perror("io_uring_enter");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t data;
+    int res;
+    while (uring_reap(&ring, &data, &res)){
+        Segment *seg = (Segment *) (uintptr_t) (data & URING_PTR_MASK);
+        size_t piece = (data >> URING_PIECE_SHIFT) * URING_READ_SIZE;
+        size_t want = seg->len - piece < URING_READ_SIZE ? seg->len - piece : URING_READ_SIZE;
+        if (res < 0){
+            errno = -res;
+            perror("io_uring read");
+            exit(EXIT_FAILURE);
+        }
+        if ((size_t) res < want){ //short read, finish it synchronously
+            read_fully(seg->fd, seg->addr + piece + res, want - res, seg->offset + piece + res);
+        }
+        seg->inflight--;
+    }
+}
+
+//begin loading a segment, NULL if it cannot be loaded
+Segment *start_segment(int fd, off_t offset, size_t len){
+    Segment *seg = malloc(sizeof(Segment));
+    size_t page = sysconf(_SC_PAGESIZE);
+    seg->addr = NULL;
+    seg->len = len;
+    seg->map_len = (len + page - 1) / page * page;
+    seg->fd = fd;
+    seg->offset = offset;
+    seg->close_fd = 0;
+    seg->inflight = 0;
+
+    switch (input_backend){
+        case INPUT_MMAP:
+            seg->addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, offset);
+            seg->map_len = len;
+            if (seg->addr != MAP_FAILED){
+                madvise(seg->addr, len, MADV_SEQUENTIAL);
+                madvise(seg->addr, len, MADV_WILLNEED);
+            }
+            break;
+        case INPUT_POPULATE:
+        case INPUT_PREAD:
+            posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+            break;
+        case INPUT_DIRECT:
+            break;
+        case INPUT_URING:
+            seg->addr = mmap(NULL, seg->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (seg->addr == MAP_FAILED){
+                break;
+            }
+            pool_place(pool, seg->addr, seg->map_len);
+            //one read per URING_READ_SIZE piece, the piece number rides in the top bits of user_data
+            for (size_t piece = 0; piece < len; piece += URING_READ_SIZE){
+                size_t want = len - piece < URING_READ_SIZE ? len - piece : URING_READ_SIZE;
+                want = (want + page - 1) / page * page; //O_DIRECT wants whole blocks
+                uint64_t data = (uint64_t) (uintptr_t) seg | (uint64_t) (piece / URING_READ_SIZE) << URING_PIECE_SHIFT;
+                while (uring_queue_read(&ring, fd, seg->addr + piece, want, offset + piece, data) != 0){
+                    uring_complete(1);
+                }
+                seg->inflight++;
+            }
+            uring_complete(0);
+            break;
+    }
+    if (seg->addr == MAP_FAILED){
+        free(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+//block until the segment's bytes are in memory
+void finish_segment(Segment *seg){
+    if (seg->fd == -1){
+        return; //buffer segments are filled when they are created
+    }
+    switch (input_backend){
+        case INPUT_MMAP:
+            break;
+        case INPUT_POPULATE:
+            seg->addr = mmap(NULL, seg->len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, seg->fd, seg->offset);
+            seg->map_len = seg->len;
+            break;
+        case INPUT_PREAD:
+        case INPUT_DIRECT:
+            seg->addr = mmap(NULL, seg->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (seg->addr != MAP_FAILED){
+                pool_place(pool, seg->addr, seg->map_len);
+                read_fully(seg->fd, seg->addr, input_backend == INPUT_DIRECT ? seg->map_len : seg->len, seg->offset);
+            }
+            break;
+        case INPUT_URING:
+            while (seg->inflight > 0){
+                uring_complete(1);
+            }
+            break;
+    }
+    if (seg->addr == MAP_FAILED){
+        perror("load input");
+        exit(EXIT_FAILURE);
+    }
+    if (seg->close_fd){
+        close(seg->fd);
+        seg->close_fd = 0;
+    }
+}
 
-Chunk chunks[1000000];
-int num_chunks = 0;
-int available[1000000];
+//wrap an already filled anonymous buffer (pipes, batches of small files)
+Segment *buffer_segment(char *addr, size_t len, size_t map_len){
+    Segment *seg = malloc(sizeof(Segment));
+    seg->addr = addr;
+    seg->len = len;
+    seg->map_len = map_len;
+    seg->fd = -1;
+    seg->offset = 0;
+    seg->close_fd = 0;
+    seg->inflight = 0;
+    return seg;
+}
 
-//int last_encoded = -1;
+/*
+    Input list: any number of files, "-" for stdin, plus --files-from lists.
+    Inputs are consumed as one stream of segments, so the read-ahead reaches
+    across file boundaries (the next file is opened and its first segment
+    started while the current one is being cut). Files up to BATCH_FILE_MAX
+    are read back to back into shared batch buffers instead of each getting
+    its own mapping and its own short chunk; the encoded output is the same
+    since chunks are stitched into one stream anyway.
+*/
+#define BATCH_FILE_MAX (256 << 10)
 
 typedef struct{
-    char *data; //data start
-    int size; //in bytes
-    int id;
-} Task;
-int num_tasks = 0; //"value"
-int total_tasks = 0;
-
-typedef struct node{
-    Task task;
-    struct node* next;
-} Node;
+    char **names;
+    size_t num, cap;
+    size_t next; //next file to open
+    int fd; //file being split into segments, -1 if none
+    int stream; //fd is a pipe or tty: size unknown, read until EOF
+    off_t size, offset;
+} Inputs;
 
+void add_input(Inputs *in, char *name){
+    if (in->num == in->cap){
+        in->cap = in->cap ? in->cap * 2 : 64;
+        in->names = realloc(in->names, in->cap * sizeof(char *));
+        if (in->names == NULL){
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    in->names[in->num++] = name;
+}
+
+//--files-from: one file name per line, "-" reads the list from stdin
+void add_inputs_from(Inputs *in, const char *list){
+    FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    if (f == NULL){
+        fprintf(stderr, "Error opening file %s\n", list);
+        exit(EXIT_FAILURE);
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, f)) != -1){
+        if (n > 0 && line[n - 1] == '\n'){
+            line[--n] = '\0';
+        }
+        if (n > 0){
+            add_input(in, strdup(line));
+        }
+    }
+    free(line);
+    if (f != stdin){
+        fclose(f);
+    }
+}
+
+int open_named_input(const char *name, struct stat *sb){
+    int fd = strcmp(name, "-") == 0 ? STDIN_FILENO : open_input(name);
+    if (fd == -1 || fstat(fd, sb) == -1){
+        fprintf(stderr, "Error opening file %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+//read from a pipe until len bytes or EOF, returns bytes read
+size_t read_stream(int fd, char *buf, size_t len){
+    size_t done = 0;
+    while (done < len){
+        ssize_t n = read(fd, buf + done, len - done);
+        if (n == -1){
+            if (errno == EINTR) continue;
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0){
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+//start loading the next segment of the input stream, NULL once every input is consumed
+Segment *next_input_segment(Inputs *in){
+    while (1){
+        if (in->fd != -1 && in->stream){
+            char *buf = mmap(NULL, map_window, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buf == MAP_FAILED){
+                perror("mmap");
+                exit(EXIT_FAILURE);
+            }
+            pool_place(pool, buf, map_window);
+            size_t len = read_stream(in->fd, buf, map_window);
+            if (len > 0){
+                return buffer_segment(buf, len, map_window);
+            }
+            munmap(buf, map_window);
+            if (in->fd != STDIN_FILENO){
+                close(in->fd);
+            }
+            in->fd = -1;
+            continue;
+        }
+        if (in->fd != -1){
+            size_t len = (size_t) (in->size - in->offset) < map_window ? (size_t) (in->size - in->offset) : map_window;
+            Segment *seg = start_segment(in->fd, in->offset, len);
+            in->offset += len;
+            if (seg == NULL || in->offset >= in->size){
+                if (seg != NULL){
+                    seg->close_fd = 1;
+                }else{
+                    close(in->fd); //mapping failed: skip the rest of this file
+                }
+                in->fd = -1;
+            }
+            if (seg != NULL){
+                return seg;
+            }
+            continue;
+        }
+        if (in->next == in->num){
+            return NULL;
+        }
+
+        struct stat sb;
+        int fd = open_named_input(in->names[in->next], &sb);
+        in->next++;
+        if (!S_ISREG(sb.st_mode)){
+            in->fd = fd;
+            in->stream = 1;
+            continue;
+        }
+        if (sb.st_size > BATCH_FILE_MAX){
+            in->fd = fd;
+            in->stream = 0;
+            in->size = sb.st_size;
+            in->offset = 0;
+            continue;
+        }
+
+        //small file: start a batch and keep adding small files while they fit
+        char *buf = mmap(NULL, map_window, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED){
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        pool_place(pool, buf, map_window);
+        size_t len = 0;
+        while (1){
+            size_t want = (size_t) sb.st_size < map_window - len ? (size_t) sb.st_size : map_window - len;
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); //buffer offsets are not block aligned
+            len += read_fully(fd, buf + len, want, 0);
+            if (fd != STDIN_FILENO){
+                close(fd);
+            }
+            if (in->next == in->num){
+                break;
+            }
+            struct stat next_sb;
+            const char *name = in->names[in->next];
+            if (strcmp(name, "-") == 0 || stat(name, &next_sb) == -1 || !S_ISREG(next_sb.st_mode)
+                    || next_sb.st_size > BATCH_FILE_MAX || len + next_sb.st_size > map_window){
+                break;
+            }
+            fd = open_named_input(name, &sb);
+            in->next++;
+        }
+        if (len > 0){
+            return buffer_segment(buf, len, map_window);
+        }
+        munmap(buf, map_window);
+    }
+}
+
+//encoder callback: every chunk of the segment is written out
+void release_segment(void *arg){
+    Segment *seg = arg;
+    munmap(seg->addr, seg->map_len);
+    free(seg);
+}
+
+/*
+    Decoding (-d): the encoded input is cut into pieces that decode on their own:
+    even-sized slices of plain pair streams (rle, framed or not), or whole
+    blocks of framed files in the other codecs. When stdout is a regular file,
+    every piece's output size is known (workers sum the pair counts; framed
+    blocks take it from the index), a prefix sum over those gives each piece its
+    output offset, and workers then expand the pieces in parallel straight into
+    stdout mapped with MAP_SHARED.
+    A stdout opened write-only cannot be mapped shared; then each worker expands
+    into its own buffer and pwrites it at the piece's offset instead.
+    Pipes and terminals cannot be seeked, so there the main thread decodes
+    everything in order through the output buffer.
+*/
+uint64_t *piece_totals; //output bytes of each piece, indexed by task id
+sem_t pieces_done;
+
+void count_task(Task *task){
+    if (task->codec == CODEC_RLE){ //other codecs: known from the frame index
+        const unsigned char *p = (const unsigned char *) task->data;
+        uint64_t total = 0;
+        for (int i = 1; i < task->size; i += 2){
+            total += p[i];
+        }
+        piece_totals[task->id] = total;
+    }
+    sem_post(&pieces_done);
+}
+
+#define DECODE_BUF_SIZE (1 << 20)
+
+void pwrite_all(const char *buf, size_t len, off_t offset){
+    while (len > 0){
+        ssize_t n = pwrite(STDOUT_FILENO, buf, len, offset);
+        if (n == -1){
+            if (errno == EINTR) continue;
+            perror("pwrite");
+            exit(EXIT_FAILURE);
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+//RunSink into memory (the mapped output file), never past the end of the piece
 typedef struct{
-    Node* head;
-    Node* tail;
-} TaskQueue;
+    char *pos;
+    char *end;
+    int overflow; //the data expanded to more than the piece holds
+} MemorySink;
 
-void init_queue(TaskQueue* queue){
-    queue->head = NULL;
-    queue->tail = NULL;
+void memory_run(void *ctx, char letter, uint64_t count){
+    MemorySink *m = ctx;
+    if (m->overflow || count > (uint64_t) (m->end - m->pos)){
+        m->overflow = 1;
+        return;
+    }
+    memset(m->pos, letter, count);
+    m->pos += count;
 }
 
-void push(TaskQueue* queue, Task task){
-    pthread_mutex_lock(&queue_mutex);
-    
-    Node* new_node = (Node*) malloc(sizeof(Node));
-    new_node->task = task;
-    new_node->next = NULL;
+void memory_literal(void *ctx, const char *bytes, size_t len){
+    MemorySink *m = ctx;
+    if (m->overflow || len > (size_t) (m->end - m->pos)){
+        m->overflow = 1;
+        return;
+    }
+    memcpy(m->pos, bytes, len);
+    m->pos += len;
+}
+
+//RunSink into a per-thread buffer pwritten at increasing offsets up to end
+typedef struct{
+    char *buf;
+    size_t len;
+    off_t offset;
+    off_t end;
+    int overflow;
+} PwriteSink;
+
+void pwrite_sink_flush(PwriteSink *p){
+    pwrite_all(p->buf, p->len, p->offset);
+    p->offset += p->len;
+    p->len = 0;
+}
+
+//whether count more bytes still fit in the piece
+static int pwrite_sink_room(PwriteSink *p, uint64_t count){
+    if (!p->overflow && count > (uint64_t) (p->end - p->offset) - p->len){
+        p->overflow = 1;
+    }
+    return !p->overflow;
+}
+
+void pwrite_run(void *ctx, char letter, uint64_t count){
+    PwriteSink *p = ctx;
+    if (!pwrite_sink_room(p, count)){
+        return;
+    }
+    while (count > 0){
+        if (p->len == DECODE_BUF_SIZE){
+            pwrite_sink_flush(p);
+        }
+        size_t n = DECODE_BUF_SIZE - p->len < count ? DECODE_BUF_SIZE - p->len : count;
+        memset(p->buf + p->len, letter, n);
+        p->len += n;
+        count -= n;
+    }
+}
+
+void pwrite_literal(void *ctx, const char *bytes, size_t len){
+    PwriteSink *p = ctx;
+    if (!pwrite_sink_room(p, len)){
+        return;
+    }
+    if (p->len + len > DECODE_BUF_SIZE){
+        pwrite_sink_flush(p);
+    }
+    memcpy(p->buf + p->len, bytes, len);
+    p->len += len;
+}
 
-    if (queue->tail == NULL){
-        queue->head = new_node;
-        queue->tail = new_node;
+//a piece must expand to exactly out_size bytes: the frame index says so for framed blocks,
+//count_task measured rle pieces
+void decode_task(Task *task){
+    static __thread char buf[DECODE_BUF_SIZE];
+    const Codec *codec = codec_by_id(task->codec);
+    MemorySink m = { .pos = task->out, .end = task->out + task->out_size };
+    PwriteSink p = { .buf = buf, .offset = task->out_offset, .end = task->out_offset + task->out_size };
+    RunSink sink = task->out != NULL ? (RunSink){ memory_run, memory_literal, &m }
+                                     : (RunSink){ pwrite_run, pwrite_literal, &p };
+    int corrupt = codec->decode((const unsigned char *) task->data, task->size, &sink) != 0;
+    if (task->out != NULL){
+        corrupt |= m.overflow || m.pos != m.end;
     }else{
-        queue->tail->next = new_node;
-        queue->tail = new_node;
+        corrupt |= p.overflow;
+        pwrite_sink_flush(&p);
+        corrupt |= p.offset != p.end;
     }
-    num_tasks++;
-    total_tasks++;
+    if (corrupt){
+        fprintf(stderr, "Corrupt %s data\n", codec->name);
+        exit(EXIT_FAILURE);
+    }
+    sem_post(&pieces_done);
+}
+
+//hand tasks to the pool (which runs them here without workers) and wait for all of them
+void run_pieces(Task *pieces, size_t num_pieces, void (*run)(Task *task)){
+    for (size_t i = 0; i < num_pieces; i++){
+        pieces[i].run = run;
+        pool_submit(pool, pieces[i].id, pieces[i]);
+    }
+    for (size_t i = 0; i < num_pieces; i++){
+        sem_wait(&pieces_done);
+    }
+}
+
+static inline void writer_put_run(Writer *w, char letter, size_t count){
+    while (count > 0){
+        if (w->len == OUT_BUF_SIZE){
+            writer_flush(w);
+        }
+        size_t n = OUT_BUF_SIZE - w->len < count ? OUT_BUF_SIZE - w->len : count;
+        memset(w->buf + w->len, letter, n);
+        w->len += n;
+        count -= n;
+    }
+}
 
-    pthread_cond_signal(&cond); //signal thread
-    pthread_mutex_unlock(&queue_mutex);
+//RunSink into the output buffer
+void writer_run(void *ctx, char letter, uint64_t count){
+    writer_put_run(ctx, letter, count);
 }
 
-Task pop(TaskQueue* queue){
-    if (queue->head == NULL){
-        perror("error: queue empty\n");
+void writer_literal(void *ctx, const char *bytes, size_t len){
+    writer_put_bytes(ctx, bytes, len);
+}
+
+//one encoded input, mapped
+typedef struct{
+    unsigned char *map; //whole file
+    size_t map_len;
+    const unsigned char *data; //encoded stream: the file, or the block region of a framed file
+    size_t len;
+    const Codec *codec;
+    int framed;
+    FrameTrailer trailer;
+} EncodedFile;
+
+void open_encoded(const char *file_name, EncodedFile *f){
+    int fd = open(file_name, O_RDONLY);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1){
+        fprintf(stderr, "Error opening file %s\n", file_name);
         exit(EXIT_FAILURE);
     }
+    f->map = NULL;
+    f->map_len = sb.st_size;
+    if (sb.st_size > 0){
+        f->map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (f->map == MAP_FAILED){
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        madvise(f->map, sb.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    f->data = f->map;
+    f->len = f->map_len;
+    f->codec = codec_by_id(CODEC_RLE);
+    f->framed = 0;
 
-    Node* removed_node = queue->head;
-    Task removed_task = removed_node->task;
-    queue->head = removed_node->next;
-    free(removed_node);
+    //framed input: the blocks are encoded streams back to back, decode that region.
+    //A legacy stream starts with "NYUF" too when the input starts with 89 N's then 70 U's,
+    //but it never ends in the trailer ("X\0" would be a zero count)
+    FrameHeader h;
+    if (frame_get_header(f->map, f->map_len, &h) == 0 && frame_get_trailer(f->map, f->map_len, &f->trailer) == 0){
+        f->codec = codec_by_id(h.codec);
+        if (f->codec == NULL){
+            fprintf(stderr, "%s: unknown codec %d\n", file_name, h.codec);
+            exit(EXIT_FAILURE);
+        }
+        if (frame_check_index(f->map, &f->trailer) != 0){
+            fprintf(stderr, "%s: corrupt frame index\n", file_name);
+            exit(EXIT_FAILURE);
+        }
+        f->framed = 1;
+        f->data = f->map + FRAME_HEADER_SIZE;
+        f->len = f->trailer.index_offset - FRAME_HEADER_SIZE;
+    }
+    if (f->codec->id == CODEC_RLE && f->len % 2 != 0){
+        fprintf(stderr, "%s: not an RLE stream (odd length)\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+}
 
-    if (queue->head == NULL){
-        queue->tail = NULL;
+//encoded bounds of block b of a framed file
+void frame_block(const EncodedFile *f, uint64_t b, FrameIndexEntry *e, uint64_t *enc_end, uint64_t *raw_end){
+    const unsigned char *index = f->map + f->trailer.index_offset;
+    frame_get_index_entry(index + b * FRAME_INDEX_ENTRY_SIZE, e);
+    *enc_end = f->trailer.index_offset;
+    *raw_end = f->trailer.raw_size;
+    if (b + 1 < f->trailer.num_blocks){
+        FrameIndexEntry next;
+        frame_get_index_entry(index + (b + 1) * FRAME_INDEX_ENTRY_SIZE, &next);
+        *enc_end = next.enc_offset;
+        *raw_end = next.raw_offset;
     }
-    
-    //num_tasks--;
-    return removed_task;
 }
-TaskQueue queue;
 
-void encode_task(Task *task){
+int decode_files(char **file_names, int num_files, Writer *out){
+    EncodedFile files[num_files];
 
-    char *data = task->data;
-    int size = task->size;
-    char *result = malloc(sizeof(char) * (size *2 + 1));//leave more than enough space for compressed result
-    unsigned char *counts = malloc(sizeof(char) * (size *2 + 1));
-    int result_size = 0;
-    
-    int i = 0, j = 0;
-    while (i < size){
-        unsigned char count = 1;
-        char current = data[i];
-        while (i < size - 1 && data[i] == data[i+1] && count < 255){
-            count++;
-            i++;
-        }
-        result[j] = current;
-        counts[j] = count;
-        j++;
-        result_size += 2;
-        i++;
-    }
-
-    Chunk chunk = {
-        .size = result_size,
-        .result = result,
-        .counts = counts
-    };
+    //OPEN FILES AND MAP TO MEMORY
+    for (int i = 0; i < num_files; i++){
+        open_encoded(file_names[i], &files[i]);
+    }
 
-    pthread_mutex_lock(&chunk_mutex);
-    int index = task->id;
-    chunks[index] = chunk;
-    available[index] = 1;
-    num_chunks++;
-    //total_chunks++;
-    pthread_cond_signal(&write_cond);
-    pthread_mutex_unlock(&chunk_mutex);
-    
-    //if main thread is stopped on a hole, we have to signal main thread to continue
-    /*
-    if (index == last_encoded + 1){
-        //pthread_cond_signal(&write_cond);
-    } //signal main thread to write
-    */
-    
+    //pieces land at their own offsets, which O_APPEND (>> even on an empty file) would ignore
+    struct stat out_sb;
+    int flags = fcntl(out->fd, F_GETFL);
+    int mappable = fstat(out->fd, &out_sb) == 0 && S_ISREG(out_sb.st_mode)
+        && lseek(out->fd, 0, SEEK_CUR) == 0 && flags != -1 && !(flags & O_APPEND);
+
+    if (!mappable){
+        RunSink sink = { writer_run, writer_literal, out };
+        for (int i = 0; i < num_files; i++){
+            if (files[i].codec->decode(files[i].data, files[i].len, &sink) != 0){
+                fprintf(stderr, "%s: corrupt %s data\n", file_names[i], files[i].codec->name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        writer_flush(out);
+        stats.bytes_out = writer_tell(out);
+        return 0;
+    }
+
+    //cut pieces: chunk_size is a page multiple, so rle pieces never split a pair
+    size_t num_pieces = 0;
+    for (int i = 0; i < num_files; i++){
+        if (files[i].codec->id == CODEC_RLE){
+            num_pieces += (files[i].len + chunk_size - 1) / chunk_size;
+        }else{
+            num_pieces += files[i].trailer.num_blocks;
+        }
+    }
+    Task *pieces = calloc(num_pieces + 1, sizeof(Task));
+    piece_totals = malloc((num_pieces + 1) * sizeof(uint64_t));
+    if (pieces == NULL || piece_totals == NULL){
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t n = 0;
+    for (int i = 0; i < num_files; i++){
+        EncodedFile *f = &files[i];
+        if (f->codec->id == CODEC_RLE){
+            for (size_t offset = 0; offset < f->len; offset += chunk_size){
+                pieces[n].id = n;
+                pieces[n].codec = CODEC_RLE;
+                pieces[n].data = (char *) f->data + offset;
+                pieces[n].size = f->len - offset < chunk_size ? f->len - offset : chunk_size;
+                n++;
+            }
+            continue;
+        }
+        for (uint64_t b = 0; b < f->trailer.num_blocks; b++){
+            FrameIndexEntry e;
+            uint64_t enc_end, raw_end;
+            frame_block(f, b, &e, &enc_end, &raw_end);
+            if (enc_end - e.enc_offset > INT_MAX){
+                fprintf(stderr, "%s: block %" PRIu64 " too large\n", file_names[i], b);
+                exit(EXIT_FAILURE);
+            }
+            pieces[n].id = n;
+            pieces[n].codec = f->codec->id;
+            pieces[n].data = (char *) f->map + e.enc_offset;
+            pieces[n].size = enc_end - e.enc_offset;
+            piece_totals[n] = raw_end - e.raw_offset;
+            n++;
+        }
+    }
+    sem_init(&pieces_done, 0, 0);
+
+    //pass 1: output size of every piece, then prefix sum into offsets
+    run_pieces(pieces, num_pieces, count_task);
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_pieces; i++){
+        uint64_t piece = piece_totals[i];
+        pieces[i].out_size = piece;
+        piece_totals[i] = total;
+        total += piece;
+    }
+
+    if (total > 0){
+        if (ftruncate(out->fd, total) == -1){
+            perror("ftruncate");
+            exit(EXIT_FAILURE);
+        }
+        char *dst = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+
+        //pass 2: expand every piece at its offset
+        for (size_t i = 0; i < num_pieces; i++){
+            pieces[i].out = dst == MAP_FAILED ? NULL : dst + piece_totals[i];
+            pieces[i].out_offset = piece_totals[i];
+        }
+        run_pieces(pieces, num_pieces, decode_task);
+        if (dst != MAP_FAILED){
+            munmap(dst, total);
+        }
+        lseek(out->fd, total, SEEK_SET);
+    }
+    stats.bytes_out = total;
+    stats.chunks = num_pieces;
+
+    free(pieces);
+    free(piece_totals);
+    for (int i = 0; i < num_files; i++){
+        if (files[i].map != NULL){
+            munmap(files[i].map, files[i].map_len);
+        }
+    }
+    return 0;
 }
 
-void* worker_function(){
-    
-    while(1){
-      
-        Task task;
-        //CRITICAL SECTION:
-        pthread_mutex_lock(&queue_mutex);
-        while(num_tasks == 0){
-            pthread_cond_wait(&cond, &queue_mutex);
+//RunSink that only passes on the bytes inside [start, end)
+typedef struct{
+    uint64_t pos, start, end;
+    Writer *out;
+} RangeSink;
+
+void range_run(void *ctx, char letter, uint64_t count){
+    RangeSink *r = ctx;
+    uint64_t from = r->pos > r->start ? r->pos : r->start;
+    uint64_t to = r->pos + count < r->end ? r->pos + count : r->end;
+    if (from < to){
+        writer_put_run(r->out, letter, to - from);
+    }
+    r->pos += count;
+}
+
+void range_literal(void *ctx, const char *bytes, size_t len){
+    RangeSink *r = ctx;
+    uint64_t from = r->pos > r->start ? r->pos : r->start;
+    uint64_t to = r->pos + len < r->end ? r->pos + len : r->end;
+    if (from < to){
+        writer_put_bytes(r->out, bytes + (from - r->pos), to - from);
+    }
+    r->pos += len;
+}
+
+/*
+    Range read (-d -x start:length) on a framed file: binary search the index
+    for the block holding start and decode only the blocks that overlap the range.
+*/
+int decode_range(const char *file_name, uint64_t start, uint64_t length, Writer *out){
+    EncodedFile f;
+    open_encoded(file_name, &f);
+    if (!f.framed){
+        fprintf(stderr, "%s: not a framed file (encode with -F)\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    if (start >= f.trailer.raw_size || f.trailer.num_blocks == 0){
+        return 0;
+    }
+    uint64_t end = length < f.trailer.raw_size - start ? start + length : f.trailer.raw_size;
+
+    const unsigned char *index = f.map + f.trailer.index_offset;
+    for (uint64_t b = frame_find_block(index, f.trailer.num_blocks, start); b < f.trailer.num_blocks; b++){
+        FrameIndexEntry e;
+        uint64_t enc_end, raw_end;
+        frame_block(&f, b, &e, &enc_end, &raw_end);
+        if (e.raw_offset >= end){
+            break;
         }
-        //"pop" task from the task queue
-        task = pop(&queue);
-        num_tasks--;
-        pthread_mutex_unlock(&queue_mutex);
+        //bytes past the block's own span would belong to the next one
+        RangeSink r = { .pos = e.raw_offset, .start = start, .end = end < raw_end ? end : raw_end, .out = out };
+        RunSink sink = { range_run, range_literal, &r };
+        if (f.codec->decode(f.map + e.enc_offset, enc_end - e.enc_offset, &sink) != 0 || r.pos != raw_end){
+            fprintf(stderr, "%s: corrupt %s data\n", file_name, f.codec->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    writer_flush(out);
+    munmap(f.map, f.map_len);
+    return 0;
+}
 
-        //RLE encode the task
-        encode_task(&task);
+//encoder sink: straight to the output file descriptor
+void fd_sink(void *ctx, const void *buf, size_t len){
+    int fd = *(int *) ctx;
+    const char *p = buf;
+    while (len > 0){
+        ssize_t n = write(fd, p, len);
+        if (n == -1){
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+//encode every input into one stream through the encoder
+void encode_inputs(Inputs *inputs, NyuEncoder *enc){
+    map_window = (MAP_WINDOW + chunk_size - 1) / chunk_size * chunk_size;
+    //OPEN FILES AND MAP TO MEMORY, one stream of segments across all inputs
+    uint64_t start = stats_clock(stats_enabled);
+    Segment *next_seg = next_input_segment(inputs);
+    while (next_seg != NULL){
+        Segment *seg = next_seg;
+        finish_segment(seg);
+
+        //read ahead: start loading the next segment (possibly of the next file) before cutting this one
+        next_seg = next_input_segment(inputs);
+        if (stats_enabled){
+            stats.input_ns += stats_now() - start;
+        }
+        if (nyu_encoder_feed_ref(enc, seg->addr, seg->len, release_segment, seg) == -1){
+            perror("nyu_encoder_feed_ref");
+            exit(EXIT_FAILURE);
+        }
+        start = stats_clock(stats_enabled);
+    }
+    if (nyu_encoder_finish(enc) == -1){
+        perror("nyu_encoder_finish");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    --bench[=MB]: encode synthetic corpora generated in memory (memfd files, so
+    they go through the normal input path) at 1, 2, 4, ... jobs up to -j (or
+    twice the CPU count) and print the best of BENCH_REPS runs in MB/s. The
+    output goes to /dev/null. Chunk size is -c, or picked per job count.
+*/
+#define BENCH_DEFAULT_MB 64
+#define BENCH_REPS 3
+
+//xorshift64, deterministic so runs are comparable
+static uint64_t bench_next(uint64_t *state){
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+//runs of min_run..max_run copies of letters from an alphabet of the given size
+int bench_corpus(const char *name, size_t size, int alphabet, int min_run, int max_run){
+    int fd = memfd_create(name, 0);
+    if (fd == -1 || ftruncate(fd, size) == -1){
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+    char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED){
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t pos = 0;
+    while (pos < size){
+        uint64_t r = bench_next(&state);
+        char letter = 'a' + r % alphabet;
+        size_t run = min_run + (r >> 32) % (max_run - min_run + 1);
+        if (run > size - pos){
+            run = size - pos;
+        }
+        memset(buf + pos, letter, run);
+        pos += run;
+    }
+    munmap(buf, size);
+    return fd;
+}
+
+int run_bench(size_t size_mb, int max_jobs, int affinity, NyuOptions opts){
+    static const struct{
+        const char *name;
+        int alphabet, min_run, max_run;
+    } corpora[] = {
+        {"low", 3, 1, 5000}, //long runs, compresses well
+        {"mixed", 26, 1, 40},
+        {"high", 256, 1, 1}, //no runs, output twice the input
+    };
+    size_t size = size_mb << 20;
+    size_t fixed_chunk = chunk_size;
+    if (max_jobs <= 0){
+        max_jobs = 2 * sysconf(_SC_NPROCESSORS_ONLN);
     }
+    int null_fd = open("/dev/null", O_WRONLY);
 
+    printf("%-8s", "corpus");
+    for (int j = 1; j <= max_jobs; j *= 2){
+        char col[16];
+        snprintf(col, sizeof(col), "-j %d", j);
+        printf("%10s", col);
+    }
+    printf("   (MB/s, best of %d, %zu MB, %s)\n", BENCH_REPS, size_mb, codec_by_id(opts.codec)->name);
+
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++){
+        int fd = bench_corpus(corpora[c].name, size, corpora[c].alphabet, corpora[c].min_run, corpora[c].max_run);
+        char name[32];
+        snprintf(name, sizeof(name), "/proc/self/fd/%d", fd);
+        printf("%-8s", corpora[c].name);
+        fflush(stdout);
+        for (int j = 1; j <= max_jobs; j *= 2){
+            chunk_size = fixed_chunk != 0 ? fixed_chunk : auto_chunk_size(size, j);
+            opts.chunk_size = chunk_size;
+            //one warm pool and encoder for all repetitions
+            pool = pool_create(j, affinity, stats_enabled);
+            NyuEncoder *enc = nyu_encoder_create(pool, &opts, fd_sink, &null_fd);
+            if (pool == NULL || enc == NULL){
+                perror("nyu_encoder_create");
+                exit(EXIT_FAILURE);
+            }
+            uint64_t best = UINT64_MAX;
+            for (int rep = 0; rep < BENCH_REPS; rep++){
+                Inputs inputs = { .names = NULL, .num = 0, .cap = 0, .next = 0, .fd = -1 };
+                add_input(&inputs, name);
+                uint64_t start = stats_now();
+                encode_inputs(&inputs, enc);
+                uint64_t elapsed = stats_now() - start;
+                free(inputs.names);
+                if (elapsed < best){
+                    best = elapsed;
+                }
+            }
+            nyu_encoder_destroy(enc);
+            pool_destroy(pool);
+            printf("%10.1f", size / 1e6 / (best / 1e9));
+            fflush(stdout);
+        }
+        printf("\n");
+        close(fd);
+    }
+    close(null_fd);
+    return 0;
 }
 
 int main(int argc, char* argv[]){
     
     int num_jobs = 0;
     int opt;
-    char* file_names[MAX_FILES];
-    int num_files = 0;
+    Inputs inputs = { .names = NULL, .num = 0, .cap = 0, .next = 0, .fd = -1 };
     int invalid = 0;
-    init_queue(&queue);
+    int decode = 0;
+    int framed = 0;
+    const Codec *codec = codec_by_id(CODEC_RLE);
+    int affinity = 0;
+    int range = 0;
+    uint64_t range_start = 0, range_length = 0;
+    int bench = 0;
+    size_t bench_mb = BENCH_DEFAULT_MB;
+    rle_scan_init();
 
-    //handle options "-j jobs"
-    while ((opt = getopt(argc, argv, "j:")) != 1){
+    static const struct option long_options[] = {
+        {"files-from", required_argument, NULL, 'f'},
+        {"stats", no_argument, NULL, 's'},
+        {"bench", optional_argument, NULL, 'b'},
+        {"affinity", no_argument, NULL, 'a'},
+        {NULL, 0, NULL, 0}
+    };
+
+    //handle options "-j jobs" "-c chunk_size" "-d" "-F" "-C codec" "-x start:length" "-I input_backend"
+    //"--files-from list" "--stats" "--bench[=MB]" "--affinity"
+    //leading '-': file names come back as option 1, so inputs keep their command line order
+    while ((opt = getopt_long(argc, argv, "-j:c:dFC:x:I:", long_options, NULL)) != -1){
         switch (opt){
             case 'j':
                 num_jobs = atoi(optarg);
                 //printf("%d\n",num_jobs);
                 break;
+            case 'c':
+                chunk_size = parse_chunk_size(optarg);
+                break;
+            case 'd':
+                decode = 1;
+                break;
+            case 'F':
+                framed = 1;
+                break;
+            case 'C':
+                codec = codec_by_name(optarg);
+                if (codec == NULL){
+                    fprintf(stderr, "Invalid codec %s (rle, vrle, packbits)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                framed = 1; //codec id lives in the frame header
+                break;
+            case 'I':
+                input_backend = parse_input_backend(optarg);
+                break;
+            case 'f':
+                add_inputs_from(&inputs, optarg);
+                break;
+            case 's':
+                stats_enabled = 1;
+                break;
+            case 'a':
+                affinity = 1;
+                break;
+            case 'b':
+                bench = 1;
+                if (optarg != NULL && (bench_mb = strtoul(optarg, NULL, 10)) == 0){
+                    fprintf(stderr, "Invalid bench size %s (MB)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 1:
+                add_input(&inputs, optarg);
+                break;
+            case 'x':
+                if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &range_start, &range_length) != 2){
+                    fprintf(stderr, "Invalid range %s (start:length)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                range = 1;
+                break;
             default:
                 invalid = 1;
                 break;
@@ -194,14 +1175,29 @@ int main(int argc, char* argv[]){
         }
     } 
 
-    while (optind < argc && num_files < MAX_FILES){
-        file_names[num_files++]= argv[optind++];
+    while (optind < argc){ //after "--"
+        add_input(&inputs, argv[optind++]);
+    }
+    char **file_names = inputs.names;
+    int num_files = inputs.num;
+
+    if (input_backend == INPUT_URING && uring_init(&ring, URING_ENTRIES) != 0){
+        fprintf(stderr, "io_uring unavailable, using pread\n");
+        input_backend = INPUT_PREAD;
+    }
+    NyuOptions opts = { .chunk_size = chunk_size, .framed = framed, .codec = codec->id, .stats = stats_enabled };
+    if (bench){
+        return run_bench(bench_mb, num_jobs, affinity, opts);
     }
 
     if (num_files == 0){
         fprintf(stderr, "No file provided\n");
         exit(EXIT_FAILURE);
     }
+    if (range && num_files > 1){
+        fprintf(stderr, "-x decodes a range of one file, %d given\n", num_files);
+        exit(EXIT_FAILURE);
+    }
 
     //TEST: print file names and # threads
     /*
@@ -211,162 +1207,54 @@ int main(int argc, char* argv[]){
         printf("File name: %s\n", file_names[i]);
     }*/
 
-    //INITIALIZE threads, mutex and condition variable
-    pthread_t threads[num_jobs]; //Thread Pool
-    for (int i = 0; i < num_jobs; i++){
-        if (pthread_create(&threads[i], NULL, worker_function, NULL) != 0){
-            fprintf(stderr,"Thread fail.\n");
-        }
-    }
-   
-    int id_counter = 0;
-    //char *data;
-    //OPEN FILES AND MAP TO MEMORY
+    off_t total_size = 0;
     for (int i = 0; i < num_files; i++){
-
-        int fd = open(file_names[i], O_RDONLY);
-        if (fd == -1){
-            fprintf(stderr, "Error opening file %s\n", file_names[i]);
-           
-        }
-
         struct stat sb;
-        if (fstat(fd, &sb) == -1){
-            fprintf(stderr, "File size error\n");
-            exit(EXIT_FAILURE);
+        if (strcmp(file_names[i], "-") != 0 && stat(file_names[i], &sb) == 0){
+            total_size += sb.st_size;
         }
-        
-        
-        char *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-        if (addr == MAP_FAILED){
-            continue;
-            /*
-            fprintf(stderr, "Mapping error\n");
-            exit(EXIT_FAILURE);
-            */
-        }
-        
-        //create TASKS, split into 4KB chunks
-        off_t offset = 0;
-        while (offset < sb.st_size){
-            size_t remaining = sb.st_size - offset;
-            
-            size_t size = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
-
-            char *start = addr + offset;
-            
-            int *id = malloc(sizeof(int));
-            *id = id_counter;
-            
-            Task task ={
-                .id = *id,
-                .size = size,
-                .data = start
-            };
-            
-            offset += size;
-
-            available[id_counter] = 0;
-            id_counter++;
-            push(&queue, task);
-            //add_task(task); 
-        }
-        close(fd);
-        
     }
-    
-    //SEQUENTIAL PART (if no thread)
-    
-    if (num_jobs == 0){
-        char last_letter = 0;
-        unsigned char last_sum = 0; 
-        int begin_chunk = 1;  
-        for (int j = 0; j < num_tasks; j++){
-            Task t = pop(&queue);
-            encode_task(&t);
-        }
-        int k = 0;
-
-        while (k < total_tasks){
-            Chunk chunk;
-            chunk = chunks[k];
-
-            char* result = chunk.result;
-            unsigned char* counts = chunk.counts;
-            int result_size = chunk.size/2;
-            char current_char;
-            unsigned char current_sum; 
-            for (int i = 0; i < result_size; i++){
-                    current_char = result[i];
-                    current_sum = counts[i];
-
-                if (last_letter == current_char && begin_chunk != 1){
-                    last_sum = last_sum + current_sum;
-                }else{
-                    if (begin_chunk != 1){
-                        fwrite(&last_letter, 1, 1, stdout);
-                        fwrite(&last_sum, 1, 1 ,stdout);
-                    }
-                    //update last letter and sum
-                    last_letter = current_char;
-                    last_sum = current_sum;
-                }
-                begin_chunk = 0;
-            }
-            k++;
-        }
-        fwrite(&last_letter, 1, 1, stdout);
-        fwrite(&last_sum, 1, 1, stdout); 
+    if (chunk_size == 0){
+        chunk_size = auto_chunk_size(total_size, num_jobs);
+    }
 
-        exit(EXIT_SUCCESS);            
+    uint64_t start = stats_clock(stats_enabled);
+    pool = pool_create(num_jobs, affinity, stats_enabled);
+    if (pool == NULL){
+        perror("pool_create");
+        exit(EXIT_FAILURE);
     }
-    
-    //If parallel--Stitch and Write RESULTS parallel
-    int k = 0;
-    char last_letter = 0;
-    unsigned char last_sum = 0; 
-    int begin_chunk = 1;  //keeping track of beginning of the chunk entry 
-    while(k < total_tasks){
-        Chunk chunk;
-
-        pthread_mutex_lock(&chunk_mutex);
-        while (available[k] == 0){
-             pthread_cond_wait(&write_cond, &chunk_mutex);
-        }
-        chunk = chunks[k];
-        
-        char* result = chunk.result;
-        unsigned char* counts = chunk.counts;
-        int result_size = chunk.size/2;
-       
-        //Write
-        //last_letter = result[0];
-        //last_sum = counts[0];
-        char current_char;
-        unsigned char current_sum;
-        
-        for (int i = 0; i < result_size; i++){
-            current_char = result[i];
-            current_sum = counts[i];
-
-            if (last_letter == current_char && begin_chunk != 1){
-                last_sum = last_sum + current_sum;
-            }else{
-                if (begin_chunk !=1){
-                    fwrite(&last_letter, 1, 1, stdout);
-                    fwrite(&last_sum, 1, 1 ,stdout);
-                }
-                //update last letter and sum
-                last_letter = current_char;
-                last_sum = current_sum;
-            }
-            begin_chunk = 0;
+   
+    static Writer out = { .fd = STDOUT_FILENO, .len = 0 }; //1 MB, keep it off the stack
+    int status = 0;
+    if (decode && range){
+        status = decode_range(file_names[0], range_start, range_length, &out);
+    }else if (decode){
+        status = decode_files(file_names, num_files, &out);
+        stats.bytes_in = total_size;
+    }else{
+        opts.chunk_size = chunk_size;
+        int out_fd = STDOUT_FILENO;
+        NyuEncoder *enc = nyu_encoder_create(pool, &opts, fd_sink, &out_fd);
+        if (enc == NULL){
+            perror("nyu_encoder_create");
+            exit(EXIT_FAILURE);
         }
-        k++;
-        pthread_mutex_unlock(&chunk_mutex);
+        encode_inputs(&inputs, enc);
+        uint64_t input_ns = stats.input_ns;
+        stats = *nyu_encoder_stats(enc);
+        stats.input_ns = input_ns;
+        nyu_encoder_destroy(enc);
+    }
+    pool_shutdown(pool); //joins the workers: their stats are final
+
+    if (stats_enabled){
+        stats.wall_ns = stats_now() - start;
+        stats.num_workers = pool->num_workers;
+        stats.workers = pool->workers;
+        stats_report(stderr, &stats, decode ? "decode" : "encode");
     }
-    fwrite(&last_letter, 1, 1, stdout);
-    fwrite(&last_sum, 1, 1, stdout);
+    pool_destroy(pool);
     //exit(EXIT_SUCCESS);
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE //MADV_HUGEPAGE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "pool.h"
+
+static void init_queue(TaskQueue* queue){
+    for (size_t i = 0; i < QUEUE_CAPACITY; i++){
+        atomic_init(&queue->slots[i].seq, i);
+    }
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    sem_init(&queue->ready, 0, 0);
+    sem_init(&queue->space, 0, QUEUE_CAPACITY);
+}
+
+static void push(TaskQueue* queue, Task task){
+    sem_wait(&queue->space); //block while the ring is full
+
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    Slot *slot;
+    while (1){
+        slot = &queue->slots[pos & (QUEUE_CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos){
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }else{
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    slot->task = task;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release); //publish
+
+    sem_post(&queue->ready); //signal thread
+}
+
+static Task pop(TaskQueue* queue){
+    sem_wait(&queue->ready); //block while the ring is empty
+
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    Slot *slot;
+    while (1){
+        slot = &queue->slots[pos & (QUEUE_CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos + 1){
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }else{
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+    Task removed_task = slot->task;
+    atomic_store_explicit(&slot->seq, pos + QUEUE_CAPACITY, memory_order_release); //recycle slot
+
+    sem_post(&queue->space);
+    return removed_task;
+}
+
+static void run_task(const Pool *pool, WorkerStats *ws, Task *task){
+    uint64_t start = stats_clock(pool->stats);
+    task->run(task);
+    if (pool->stats){
+        ws->tasks++;
+        ws->bytes += task->size;
+        ws->busy_ns += stats_now() - start;
+    }
+}
+
+typedef struct{
+    Pool *pool;
+    int index;
+} WorkerArg;
+
+static void* worker_function(void *arg){
+    WorkerArg *wa = arg;
+    Pool *pool = wa->pool;
+    WorkerStats *ws = &pool->workers[wa->index];
+    TaskQueue *queue = &pool->queues[wa->index % pool->num_groups];
+    free(wa);
+
+    while(1){
+      
+        //"pop" task from the task queue, sleeps while it is empty
+        uint64_t start = stats_clock(pool->stats);
+        Task task = pop(queue);
+        if (pool->stats){
+            ws->idle_ns += stats_now() - start;
+        }
+        if (task.run == NULL){
+            return NULL;
+        }
+
+        //RLE encode or decode the task
+        run_task(pool, ws, &task);
+    }
+
+}
+
+//INITIALIZE the thread pool, every worker gets its own stats record; NULL (errno set) if out of
+//memory or a thread cannot be started
+Pool *pool_create(int num_workers, int affinity, int stats){
+    Pool *pool = calloc(1, sizeof(Pool));
+    if (pool == NULL){
+        return NULL;
+    }
+    pool->num_workers = num_workers;
+    pool->affinity = affinity;
+    pool->stats = stats;
+    pool->num_groups = 1;
+    if (affinity){
+        topology_init(&pool->topo);
+        if (num_workers > 0){
+            pool->num_groups = pool->topo.num_nodes < num_workers ? pool->topo.num_nodes : num_workers;
+        }
+    }
+    pool->queues = aligned_alloc(CACHE_LINE, pool->num_groups * sizeof(TaskQueue));
+    pool->workers = aligned_alloc(CACHE_LINE, (num_workers + 1) * sizeof(WorkerStats));
+    pool->threads = malloc((num_workers + 1) * sizeof(pthread_t)); //Thread Pool
+    if (pool->queues == NULL || pool->workers == NULL || pool->threads == NULL){
+        free(pool->queues);
+        free(pool->workers);
+        free(pool->threads);
+        if (affinity){
+            topology_free(&pool->topo);
+        }
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, (num_workers + 1) * sizeof(WorkerStats));
+    for (int q = 0; q < pool->num_groups; q++){
+        init_queue(&pool->queues[q]);
+    }
+
+    for (int i = 0; i < num_workers; i++){
+        WorkerArg *wa = malloc(sizeof(WorkerArg));
+        int err = wa == NULL ? ENOMEM : 0;
+        if (wa != NULL){
+            wa->pool = pool;
+            wa->index = i;
+            err = pthread_create(&pool->threads[i], NULL, worker_function, wa);
+        }
+        if (err != 0){
+            //stop the workers already running, then hand back the error
+            free(wa);
+            pool->num_workers = i;
+            pool_destroy(pool);
+            errno = err;
+            return NULL;
+        }
+        if (affinity){
+            //worker i: group i % num_groups, spread over that node's CPUs
+            NumaNode *node = &pool->topo.nodes[i % pool->num_groups];
+            topology_pin(pool->threads[i], node->cpus[(i / pool->num_groups) % node->num_cpus]);
+        }
+    }
+    return pool;
+}
+
+//one exit task per worker, then join them: afterwards every worker's stats are final
+void pool_shutdown(Pool *pool){
+    if (pool->stopped){
+        return;
+    }
+    Task exit_task = { .run = NULL };
+    for (int i = 0; i < pool->num_workers; i++){
+        push(&pool->queues[i % pool->num_groups], exit_task);
+    }
+    for (int i = 0; i < pool->num_workers; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->stopped = 1;
+}
+
+void pool_destroy(Pool *pool){
+    pool_shutdown(pool);
+    free(pool->threads);
+    free(pool->queues);
+    free(pool->workers);
+    if (pool->affinity){
+        topology_free(&pool->topo);
+    }
+    free(pool);
+}
+
+void pool_submit(Pool *pool, size_t key, Task task){
+    if (pool->num_workers == 0){
+        //no workers: run in place, the ring would fill up with nobody to drain it
+        run_task(pool, &pool->workers[pool->num_workers], &task);
+        return;
+    }
+    push(&pool->queues[pool_group(pool, key)], task);
+}
+
+void pool_place(const Pool *pool, void *addr, size_t len){
+    if (!pool->affinity){
+        return;
+    }
+    madvise(addr, len, MADV_HUGEPAGE);
+    if (pool->num_groups > 1){
+        topology_interleave(addr, len, &pool->topo);
+    }
+}
+
+int pool_bind(const Pool *pool, void *addr, size_t len, size_t key){
+    if (pool->num_groups == 1){
+        return 0;
+    }
+    return topology_bind(addr, len, pool->topo.nodes[pool_group(pool, key)].id);
+}
@@ -0,0 +1,87 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "stats.h"
+#include "topology.h"
+
+/*
+    Worker pool shared by every encoder (and the CLI's decoder): a fixed set of
+    threads popping tasks from lock-free rings. A task carries the function to
+    run and its owner, so any number of encoders can use one pool at once.
+*/
+typedef struct task Task;
+
+struct task{
+    void (*run)(Task *task); //NULL: stop the worker that pops it
+    void *ctx; //owner of the task (an encoder, ...)
+    char *data; //data start
+    int size; //in bytes
+    size_t id;
+    char *out; //decode: destination of the expanded bytes, NULL to pwrite at out_offset
+    off_t out_offset;
+    uint64_t out_size; //decode: bytes the piece expands to
+    int codec; //decode: codec id of the piece
+};
+
+/*
+    Task queue: bounded lock-free ring (Vyukov MPMC queue).
+    Every slot carries a sequence number: a slot is free for the push with ticket t
+    when seq == t, and holds a task for the pop with ticket t when seq == t + 1.
+    Pushers and poppers only CAS their own ticket counter, so workers never
+    serialize on a mutex. Blocking is done with two semaphores (free slots and
+    ready tasks); glibc semaphores only enter the kernel when someone is asleep.
+*/
+#define QUEUE_CAPACITY 4096 //must be a power of two
+#define CACHE_LINE 64
+
+typedef struct{
+    atomic_size_t seq;
+    Task task;
+} Slot;
+
+typedef struct{
+    Slot slots[QUEUE_CAPACITY];
+    _Alignas(CACHE_LINE) atomic_size_t tail; //next ticket to push
+    _Alignas(CACHE_LINE) atomic_size_t head; //next ticket to pop
+    sem_t ready; //number of tasks that can be popped
+    sem_t space; //number of free slots
+} TaskQueue;
+
+/*
+    Placement (affinity): workers are split into one group per NUMA node
+    (num_groups groups, never more than there are workers), each group pinned
+    to its node's CPUs and fed by its own task queue. Callers route a task by
+    a key (encoders use the window slot) so work on the same buffer always
+    lands on the same node. Without affinity there is one group and the
+    kernel places everything.
+*/
+typedef struct pool{
+    int num_workers; //0: tasks run on the submitting thread
+    int num_groups;
+    TaskQueue *queues; //one per group
+    pthread_t *threads;
+    WorkerStats *workers; //num_workers + 1, the last one is the submitting thread (-j 0)
+    int affinity;
+    int stats; //time tasks and waits into workers[]
+    Topology topo; //affinity only
+    int stopped; //workers joined
+} Pool;
+
+Pool *pool_create(int num_workers, int affinity, int stats);
+void pool_shutdown(Pool *pool); //waits for queued tasks, then joins every worker
+void pool_destroy(Pool *pool); //shutdown, then free
+void pool_submit(Pool *pool, size_t key, Task task);
+void pool_place(const Pool *pool, void *addr, size_t len); //placement hints for an anonymous buffer
+int pool_bind(const Pool *pool, void *addr, size_t len, size_t key); //prefer the node of key's group
+
+static inline int pool_group(const Pool *pool, size_t key){
+    return key % pool->num_groups;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include <string.h>
+#include "rle_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/*
+    Run detection kernels.
+    Each kernel returns the length of the run starting at data[0] (at least 1,
+    at most size). The vector versions compare 16 or 32 bytes at a time against
+    the first byte and use the movemask of the mismatches to find the boundary,
+    so long runs (zero-filled images etc.) cost one compare per vector.
+    The input is only read, never written, so it can point straight into the mmap.
+*/
+
+typedef size_t (*run_scan_fn)(const unsigned char *data, size_t size);
+
+static size_t run_length_scalar(const unsigned char *data, size_t size){
+    size_t i = 1;
+    while (i < size && data[i] == data[0]){
+        i++;
+    }
+    return i;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static size_t run_length_sse2(const unsigned char *data, size_t size){
+    if (size < 2 || data[1] != data[0]){ //short runs are the common case on high-entropy data
+        return 1;
+    }
+    __m128i c = _mm_set1_epi8((char) data[0]);
+    size_t i = 0;
+    while (i + 16 <= size){
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, c));
+        if (mask != 0xffff){
+            return i + __builtin_ctz(~mask);
+        }
+        i += 16;
+    }
+    while (i < size && data[i] == data[0]){
+        i++;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t run_length_avx2(const unsigned char *data, size_t size){
+    if (size < 2 || data[1] != data[0]){
+        return 1;
+    }
+    __m256i c = _mm256_set1_epi8((char) data[0]);
+    size_t i = 0;
+    while (i + 32 <= size){
+        __m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c));
+        if (mask != 0xffffffffu){
+            return i + __builtin_ctz(~mask);
+        }
+        i += 32;
+    }
+    while (i < size && data[i] == data[0]){
+        i++;
+    }
+    return i;
+}
+#endif
+
+static const struct{
+    const char *name;
+    run_scan_fn fn;
+} kernels[] = {
+#ifdef HAVE_X86_SIMD
+    {"avx2", run_length_avx2},
+    {"sse2", run_length_sse2},
+#endif
+    {"scalar", run_length_scalar},
+};
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static int selected = NUM_KERNELS - 1; //scalar until rle_scan_init() runs
+
+static int kernel_supported(const char *name){
+#ifdef HAVE_X86_SIMD
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+//pick the widest kernel the CPU supports, call before starting threads
+void rle_scan_init(void){
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < NUM_KERNELS; i++){
+        if (kernel_supported(kernels[i].name)){
+            selected = i;
+            return;
+        }
+    }
+}
+
+//force a kernel by name (benchmarks), returns -1 if unknown or unsupported
+int rle_scan_select(const char *name){
+    for (size_t i = 0; i < NUM_KERNELS; i++){
+        if (strcmp(kernels[i].name, name) == 0 && kernel_supported(name)){
+            selected = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *rle_scan_name(void){
+    return kernels[selected].name;
+}
+
+size_t run_length(const unsigned char *data, size_t size){
+    return kernels[selected].fn(data, size);
+}
+
+//RLE encode one chunk into pairs (room for size pairs), runs are capped at 255
+//returns number of pairs written
+int rle_encode(const char *data, int size, Pair *pairs){
+    const unsigned char *p = (const unsigned char *) data;
+    int i = 0, j = 0;
+    while (i < size){
+        size_t run = run_length(p + i, size - i);
+        i += run;
+        while (run > 255){
+            pairs[j].letter = p[i - run];
+            pairs[j].count = 255;
+            j++;
+            run -= 255;
+        }
+        pairs[j].letter = p[i - 1];
+        pairs[j].count = run;
+        j++;
+    }
+    return j;
+}
@@ -0,0 +1,19 @@
+#ifndef _RLE_SCAN_H_
+#define _RLE_SCAN_H_
+
+#include <stddef.h>
+
+//one RLE run, runs longer than 255 are split into several pairs
+typedef struct{
+    char letter;
+    unsigned char count;
+} Pair;
+
+void rle_scan_init(void);
+int rle_scan_select(const char *name);
+const char *rle_scan_name(void);
+
+size_t run_length(const unsigned char *data, size_t size);
+int rle_encode(const char *data, int size, Pair *pairs);
+
+#endif
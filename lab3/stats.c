@@ -0,0 +1,50 @@
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+uint64_t stats_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double seconds(uint64_t ns){
+    return ns / 1e9;
+}
+
+void stats_report(FILE *f, const Stats *s, const char *mode){
+    fprintf(f, "nyuenc %s: %d worker(s), %" PRIu64 " chunk(s)\n", mode, s->num_workers, s->chunks);
+    fprintf(f, "  %-16s%10.3f s\n", "wall", seconds(s->wall_ns));
+    fprintf(f, "  %-16s%10.3f s\n", "input", seconds(s->input_ns));
+    fprintf(f, "  %-16s%10.3f s\n", "task cutting", seconds(s->cut_ns));
+    fprintf(f, "  %-16s%10.3f s\n", "queue full", seconds(s->queue_full_ns));
+    fprintf(f, "  %-16s%10.3f s\n", "stitch", seconds(s->stitch_ns));
+    fprintf(f, "  %-16s%10.3f s  (%" PRIu64 " waits)\n", "stitch stalls", seconds(s->stall_ns), s->stalls);
+
+    fprintf(f, "  %-8s%10s%12s%12s%12s\n", "worker", "tasks", "MB", "busy s", "idle s");
+    for (int i = 0; i <= s->num_workers; i++){
+        const WorkerStats *w = &s->workers[i];
+        if (i == s->num_workers && w->tasks == 0){
+            break; //main thread only encodes with -j 0
+        }
+        char name[16];
+        if (i == s->num_workers){
+            snprintf(name, sizeof(name), "main");
+        }else{
+            snprintf(name, sizeof(name), "%d", i);
+        }
+        fprintf(f, "  %-8s%10" PRIu64 "%12.1f%12.3f%12.3f\n", name, w->tasks, w->bytes / 1e6,
+            seconds(w->busy_ns), seconds(w->idle_ns));
+    }
+
+    fprintf(f, "  %-16s%14" PRIu64 "\n", "bytes in", s->bytes_in);
+    fprintf(f, "  %-16s%14" PRIu64 "\n", "bytes out", s->bytes_out);
+    if (s->bytes_out > 0){
+        fprintf(f, "  %-16s%14.3f\n", "ratio in/out", (double) s->bytes_in / s->bytes_out);
+    }
+    if (s->wall_ns > 0){
+        uint64_t raw = strcmp(mode, "decode") == 0 ? s->bytes_out : s->bytes_in; //uncompressed side
+        fprintf(f, "  %-16s%14.1f MB/s\n", "throughput", raw / 1e6 / seconds(s->wall_ns));
+    }
+}
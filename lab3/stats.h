@@ -0,0 +1,41 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+    Run statistics for --stats. Every stage adds the nanoseconds it spent to its
+    own counter; each worker has its own cache-line-sized record so workers never
+    share a counter. Timing is switched on per pool and per encoder, and every
+    measurement is guarded by that flag.
+*/
+typedef struct{
+    _Alignas(64) uint64_t tasks;
+    uint64_t bytes; //input bytes of the tasks
+    uint64_t busy_ns; //encoding/decoding
+    uint64_t idle_ns; //waiting for a task
+} WorkerStats;
+
+typedef struct{
+    uint64_t wall_ns;
+    uint64_t input_ns; //mapping/reading input segments
+    uint64_t cut_ns; //task generation
+    uint64_t queue_full_ns; //main thread waiting for room in the task ring
+    uint64_t stitch_ns; //stitching and writing out chunks
+    uint64_t stall_ns; //stitcher waiting for the next chunk in order
+    uint64_t stalls;
+    uint64_t chunks;
+    uint64_t bytes_in, bytes_out;
+    int num_workers;
+    WorkerStats *workers; //num_workers + 1, the last one is the main thread (-j 0)
+} Stats;
+
+uint64_t stats_now(void); //monotonic clock in nanoseconds
+void stats_report(FILE *f, const Stats *s, const char *mode);
+
+static inline uint64_t stats_clock(int enabled){
+    return enabled ? stats_now() : 0;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE //CPU_SET, pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "topology.h"
+
+#define MAX_NODES 1024
+#define MASK_WORDS (MAX_NODES / (8 * sizeof(unsigned long)))
+
+//parse a sysfs cpulist ("0-3,8-11") keeping only allowed CPUs
+static int parse_cpulist(const char *list, const cpu_set_t *allowed, int *cpus){
+    int n = 0;
+    const char *p = list;
+    while (*p != '\0' && *p != '\n'){
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p){
+            break;
+        }
+        if (*end == '-'){
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++){
+            if (CPU_ISSET(cpu, allowed)){
+                cpus[n++] = cpu;
+            }
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+void topology_init(Topology *t){
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+        CPU_ZERO(&allowed);
+        for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++){
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    int max_cpus = CPU_COUNT(&allowed);
+    t->num_nodes = 0;
+    t->nodes = calloc(MAX_NODES, sizeof(NumaNode));
+
+    for (int node = 0; node < MAX_NODES; node++){
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (f == NULL){
+            continue; //node numbers can have holes
+        }
+        char list[4096];
+        if (fgets(list, sizeof(list), f) != NULL){
+            NumaNode *n = &t->nodes[t->num_nodes];
+            n->cpus = malloc(max_cpus * sizeof(int));
+            n->num_cpus = parse_cpulist(list, &allowed, n->cpus);
+            n->id = node;
+            if (n->num_cpus > 0){
+                t->num_nodes++;
+            }else{
+                free(n->cpus);
+            }
+        }
+        fclose(f);
+    }
+
+    if (t->num_nodes == 0){ //no sysfs node info: one node with every allowed CPU
+        NumaNode *n = &t->nodes[0];
+        n->id = 0;
+        n->cpus = malloc(max_cpus * sizeof(int));
+        n->num_cpus = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE && n->num_cpus < max_cpus; cpu++){
+            if (CPU_ISSET(cpu, &allowed)){
+                n->cpus[n->num_cpus++] = cpu;
+            }
+        }
+        t->num_nodes = 1;
+    }
+}
+
+void topology_free(Topology *t){
+    for (int i = 0; i < t->num_nodes; i++){
+        free(t->nodes[i].cpus);
+    }
+    free(t->nodes);
+    t->nodes = NULL;
+    t->num_nodes = 0;
+}
+
+int topology_pin(pthread_t thread, int cpu){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+static long mbind(void *addr, size_t len, int mode, const unsigned long *mask){
+    return syscall(SYS_mbind, addr, len, mode, mask, MAX_NODES, 0);
+}
+
+int topology_bind(void *addr, size_t len, int node){
+    unsigned long mask[MASK_WORDS];
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return mbind(addr, len, MPOL_PREFERRED, mask) == 0 ? 0 : -1;
+}
+
+int topology_interleave(void *addr, size_t len, const Topology *t){
+    unsigned long mask[MASK_WORDS];
+    memset(mask, 0, sizeof(mask));
+    for (int i = 0; i < t->num_nodes; i++){
+        int node = t->nodes[i].id;
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    }
+    return mbind(addr, len, MPOL_INTERLEAVE, mask) == 0 ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+    CPU/NUMA topology for --affinity: the NUMA nodes from
+    /sys/devices/system/node, each with the CPUs this process may run on
+    (sched_getaffinity). Nodes without allowed CPUs are dropped. Without sysfs
+    (or NUMA) everything is one node, so the same code runs on any box.
+*/
+typedef struct{
+    int id; //kernel node number
+    int num_cpus;
+    int *cpus;
+} NumaNode;
+
+typedef struct{
+    int num_nodes;
+    NumaNode *nodes;
+} Topology;
+
+void topology_init(Topology *t);
+void topology_free(Topology *t);
+int topology_pin(pthread_t thread, int cpu); //0 on success
+int topology_bind(void *addr, size_t len, int node); //prefer node for the pages, 0 on success
+int topology_interleave(void *addr, size_t len, const Topology *t); //0 on success
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+/*
+    Minimal io_uring wrapper over the raw syscalls (no liburing dependency),
+    only what nyuenc's read-ahead needs: queue reads, submit, reap completions.
+*/
+typedef struct{
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned queued; //sqes filled but not yet submitted
+} Uring;
+
+int uring_init(Uring *r, unsigned entries);
+int uring_queue_read(Uring *r, int fd, void *buf, unsigned len, off_t offset, uint64_t user_data);
+int uring_submit(Uring *r, unsigned wait_nr);
+int uring_reap(Uring *r, uint64_t *user_data, int *res);
+void uring_exit(Uring *r);
+
+#endif
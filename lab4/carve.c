@@ -0,0 +1,417 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "carve.h"
+
+#define MAX_STATES 64
+
+//a file type by the bytes it starts and ends with
+typedef struct signature{
+    const char *extension;
+    const char *header;
+    unsigned header_len;
+    const char *footer;
+    unsigned footer_len;
+    int last_footer;            //take the last footer before the next file, not the first
+    uint64_t max_size;
+} Signature;
+
+static const Signature signatures[] = {
+    //no footer: an EXIF thumbnail has an FF D9 of its own, so the end is found by walking the
+    //segments
+    {"jpg", "\xFF\xD8\xFF", 3, NULL, 0, 0, (uint64_t) 64 << 20},
+    {"png", "\x89PNG\r\n\x1A\n", 8, "IEND\xAE\x42\x60\x82", 8, 0, (uint64_t) 64 << 20},
+    //an incrementally saved PDF has an %%EOF per save
+    {"pdf", "%PDF-", 5, "%%EOF", 5, 1, (uint64_t) 256 << 20},
+    //the end of central directory record; its comment follows, and a stored archive inside
+    //has one too, told apart by where it says the central directory is
+    {"zip", "PK\x03\x04", 4, "PK\x05\x06", 4, 0, (uint64_t) 1024 << 20},
+};
+
+#define NUM_TYPES (sizeof(signatures) / sizeof(signatures[0]))
+_Static_assert(2 * NUM_TYPES <= 32, "every header and footer needs a bit in Matcher.out");
+
+//pattern p is the header (p even) or footer (p odd) of type p / 2
+static const char *pattern(unsigned p, unsigned *len){
+    const Signature *s = &signatures[p / 2];
+    *len = p % 2 ? s->footer_len : s->header_len;
+    return p % 2 ? s->footer : s->header;
+}
+
+//Aho-Corasick automaton over every header and footer, as a full transition table so the
+//scan costs one lookup per byte whatever the number of patterns
+typedef struct matcher{
+    uint8_t next[MAX_STATES][256];
+    uint32_t out[MAX_STATES];   //bit p: pattern p ends in this state
+    unsigned max_len;
+} Matcher;
+
+static void matcher_build(Matcher *m){
+    int child[MAX_STATES][256];
+    uint8_t fail[MAX_STATES] = {0}, queue[MAX_STATES];
+    unsigned num_states = 1;
+    memset(child, -1, sizeof(child));
+    memset(m->out, 0, sizeof(m->out));
+    m->max_len = 0;
+    for (unsigned p = 0; p < 2 * NUM_TYPES; p++){
+        unsigned len, s = 0;
+        const unsigned char *bytes = (const unsigned char *) pattern(p, &len);
+        if (len == 0){
+            continue; //a type without a footer
+        }
+        for (unsigned i = 0; i < len; i++){
+            if (child[s][bytes[i]] < 0){
+                child[s][bytes[i]] = num_states++;
+            }
+            s = child[s][bytes[i]];
+        }
+        m->out[s] |= 1u << p;
+        if (len > m->max_len) m->max_len = len;
+    }
+    //breadth first, so a state's failure state is finished before it
+    unsigned head = 0, tail = 0;
+    for (unsigned c = 0; c < 256; c++){
+        if (child[0][c] < 0){
+            m->next[0][c] = 0;
+        }else{
+            m->next[0][c] = child[0][c];
+            queue[tail++] = child[0][c];
+        }
+    }
+    while (head < tail){
+        unsigned s = queue[head++];
+        m->out[s] |= m->out[fail[s]];
+        for (unsigned c = 0; c < 256; c++){
+            if (child[s][c] < 0){
+                m->next[s][c] = m->next[fail[s]][c];
+            }else{
+                m->next[s][c] = child[s][c];
+                fail[child[s][c]] = m->next[fail[s]][c];
+                queue[tail++] = child[s][c];
+            }
+        }
+    }
+}
+
+typedef struct event{
+    uint64_t end;               //data-region offset just past the match
+    unsigned pattern;
+} Event;
+
+//one thread's share of the scan
+typedef struct carve_job{
+    const Volume *v;
+    const ClusterMap *map;
+    const Matcher *m;
+    unsigned first;             //clusters [first, last)
+    unsigned last;
+    Event *events;              //in offset order
+    unsigned count;
+    unsigned cap;
+    int failed;
+} CarveJob;
+
+static void record(CarveJob *j, uint64_t end, uint32_t mask){
+    for (unsigned p = 0; mask != 0; p++, mask >>= 1){
+        unsigned len;
+        pattern(p, &len);
+        //files start on a cluster boundary, so a header anywhere else is just data
+        if (!(mask & 1) || (p % 2 == 0 && ((end - len) & (j->v->bytes_per_cluster - 1)) != 0)){
+            continue;
+        }
+        if (j->count == j->cap){
+            unsigned cap = j->cap ? j->cap * 2 : 1024;
+            Event *e = realloc(j->events, cap * sizeof(*e));
+            if (e == NULL){
+                j->failed = 1;
+                return;
+            }
+            j->events = e;
+            j->cap = cap;
+        }
+        j->events[j->count++] = (Event) {end, p};
+    }
+}
+
+//Matches run on across free clusters that follow each other and stop at allocated ones.
+//A match is reported by the job its last byte falls in, so the state is primed with the
+//end of the cluster before the range and a footer across the boundary is found exactly once.
+static void *carve_worker(void *arg){
+    CarveJob *j = arg;
+    const Volume *v = j->v;
+    const Matcher *m = j->m;
+    unsigned bpc = v->bytes_per_cluster, state = 0;
+    VolumeCursor cur;
+    cursor_open(&cur, v, MADV_SEQUENTIAL);
+    if (j->first > 2 && cluster_free(j->map, j->first - 1)){
+        const unsigned char *p = (const unsigned char *) cursor_cluster(&cur, j->first - 1);
+        for (unsigned i = bpc - (m->max_len - 1); i < bpc; i++){
+            state = m->next[state][p[i]];
+        }
+    }
+    for (unsigned c = j->first; c < j->last && !j->failed; c++){
+        if (!cluster_free(j->map, c)){
+            state = 0;
+            continue;
+        }
+        const unsigned char *p = (const unsigned char *) cursor_cluster(&cur, c);
+        uint64_t base = volume_cluster_offset(v, c);
+        for (unsigned i = 0; i < bpc; i++){
+            state = m->next[state][p[i]];
+            if (m->out[state]){
+                record(j, base + i + 1, m->out[state]);
+            }
+        }
+    }
+    cursor_close(&cur);
+    return NULL;
+}
+
+//data-region byte at offset, if it is in a free cluster
+static int free_byte(VolumeCursor *cur, const ClusterMap *map, uint64_t offset, unsigned char *b){
+    const Volume *v = cur->v;
+    unsigned cluster = 2 + (offset >> v->cluster_shift);
+    if (cluster >= v->num_clusters + 2 || !cluster_free(map, cluster)){
+        return 0;
+    }
+    *b = *cursor_data(cur, offset);
+    return 1;
+}
+
+//n-byte little-endian (big_endian 0) or big-endian number at offset, if it is all in free clusters
+static int free_number(VolumeCursor *cur, const ClusterMap *map, uint64_t offset, unsigned n, int big_endian, uint64_t *value){
+    unsigned char b;
+    *value = 0;
+    for (unsigned i = 0; i < n; i++){
+        if (!free_byte(cur, map, offset + i, &b)){
+            return 0;
+        }
+        *value |= (uint64_t) b << 8 * (big_endian ? n - 1 - i : i);
+    }
+    return 1;
+}
+
+//whether every cluster of [start, end) is free
+static int free_run(const Volume *v, const ClusterMap *map, uint64_t start, uint64_t end){
+    for (uint64_t c = 2 + (start >> v->cluster_shift); c <= 1 + ((end - 1) >> v->cluster_shift); c++){
+        if (c >= v->num_clusters + 2 || !cluster_free(map, c)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//just past the EOI of the JPEG at start, or 0: marker segments are skipped by their lengths up
+//to each SOS, whose entropy-coded data runs to the next marker that is not a stuffed FF 00 or
+//a restart. Anything embedded in a segment, like an EXIF thumbnail, is passed over whole.
+static uint64_t jpeg_end(VolumeCursor *cur, const ClusterMap *map, uint64_t start, uint64_t max_size){
+    uint64_t pos = start + 2, len;
+    unsigned char b;
+    while (pos - start <= max_size){
+        if (!free_byte(cur, map, pos, &b) || b != 0xFF){
+            return 0;
+        }
+        do{
+            pos++; //fill bytes before the marker
+        }while (free_byte(cur, map, pos, &b) && b == 0xFF);
+        if (!free_byte(cur, map, pos, &b)){
+            return 0;
+        }
+        pos++;
+        if (b == 0xD9){
+            return pos;
+        }
+        if (b == 0x01 || (b >= 0xD0 && b <= 0xD7)){
+            continue; //no length
+        }
+        if (b == 0x00 || b == 0xD8 || !free_number(cur, map, pos, 2, 1, &len) || len < 2){
+            return 0;
+        }
+        pos += len;
+        if (b != 0xDA){
+            continue;
+        }
+        while (pos - start <= max_size){
+            if (!free_byte(cur, map, pos, &b)){
+                return 0;
+            }
+            if (b != 0xFF){
+                pos++;
+                continue;
+            }
+            if (!free_byte(cur, map, pos + 1, &b)){
+                return 0;
+            }
+            if (b != 0x00 && (b < 0xD0 || b > 0xD7)){
+                break; //a marker, FF fill included
+            }
+            pos += 2;
+        }
+    }
+    return 0;
+}
+
+//whether the end of central directory record ending its signature at end closes the ZIP at
+//start: its central directory must finish where the record begins
+static int zip_footer_fits(VolumeCursor *cur, const ClusterMap *map, uint64_t start, uint64_t end){
+    uint64_t cd_size, cd_offset;
+    return free_number(cur, map, end + 8, 4, 0, &cd_size) && free_number(cur, map, end + 12, 4, 0, &cd_offset)
+        && start + cd_offset + cd_size == end - 4;
+}
+
+//bytes after the footer that still belong to the file
+static uint64_t footer_tail(VolumeCursor *cur, const ClusterMap *map, int type, uint64_t end){
+    unsigned char b[2];
+    if (strcmp(signatures[type].extension, "pdf") == 0){
+        //the line end after %%EOF
+        uint64_t n = 0;
+        if (free_byte(cur, map, end, &b[0]) && b[0] == '\r') n++;
+        if (free_byte(cur, map, end + n, &b[0]) && b[0] == '\n') n++;
+        return n;
+    }
+    if (strcmp(signatures[type].extension, "zip") == 0){
+        //18 more bytes of record, the last two the comment length
+        if (!free_byte(cur, map, end + 16, &b[0]) || !free_byte(cur, map, end + 17, &b[1])){
+            return 0;
+        }
+        return 18 + (b[0] | (unsigned) b[1] << 8);
+    }
+    return 0;
+}
+
+//pairs each header with its footer: the first after it, or for last_footer types the last one
+//before the next header of that type. Headers of other files in between are skipped, since an
+//archive or document may store them whole. The file must lie in free clusters that follow
+//each other.
+static int pair_events(const Volume *v, const ClusterMap *map, const Event *e, unsigned n,
+                       Carved **found, unsigned *count){
+    unsigned cap = 0;
+    uint64_t carved_until = 0;
+    VolumeCursor cur;
+    cursor_open(&cur, v, MADV_NORMAL);
+    *found = NULL;
+    *count = 0;
+    for (unsigned k = 0; k < n; k++){
+        if (e[k].pattern % 2 != 0){
+            continue;
+        }
+        int type = e[k].pattern / 2;
+        const Signature *s = &signatures[type];
+        uint64_t start = e[k].end - s->header_len;
+        if (start < carved_until){
+            continue; //something stored inside the file just carved
+        }
+        uint64_t end = 0, checked = start + v->bytes_per_cluster;
+        if (strcmp(s->extension, "jpg") == 0){
+            end = jpeg_end(&cur, map, start, s->max_size);
+            if (end != 0 && !free_run(v, map, start, end)){
+                end = 0;
+            }
+        }
+        for (unsigned q = k + 1; q < n && strcmp(s->extension, "jpg") != 0; q++){
+            if (e[q].end - start > s->max_size){
+                break;
+            }
+            int contiguous = 1;
+            for (; checked < e[q].end && contiguous; checked += v->bytes_per_cluster){
+                unsigned c = 2 + (checked >> v->cluster_shift);
+                contiguous = c < v->num_clusters + 2 && cluster_free(map, c);
+            }
+            if (!contiguous || (s->last_footer && e[q].pattern == e[k].pattern)){
+                break;
+            }
+            if (e[q].pattern % 2 == 0){
+                continue; //a file stored inside this one
+            }
+            if (e[q].pattern == 2 * (unsigned) type + 1){
+                if (strcmp(s->extension, "zip") == 0 && !zip_footer_fits(&cur, map, start, e[q].end)){
+                    continue;
+                }
+                end = e[q].end;
+                if (!s->last_footer) break;
+            }
+        }
+        if (end == 0){
+            continue;
+        }
+        uint64_t size = end - start + footer_tail(&cur, map, type, end);
+        if (*count == cap){
+            cap = cap ? cap * 2 : 64;
+            Carved *p = realloc(*found, cap * sizeof(*p));
+            if (p == NULL){
+                free(*found);
+                *found = NULL;
+                cursor_close(&cur);
+                return -1;
+            }
+            *found = p;
+        }
+        (*found)[(*count)++] = (Carved) {2 + (start >> v->cluster_shift), volume_clusters_for(v, size), size, type};
+        carved_until = start + size;
+    }
+    cursor_close(&cur);
+    return 0;
+}
+
+int carve_scan(const Volume *v, const ClusterMap *map, int num_jobs, Carved **found, unsigned *count){
+    Matcher *m = malloc(sizeof(*m));
+    if (m == NULL){
+        return -1;
+    }
+    matcher_build(m);
+    unsigned total = v->num_clusters;
+    if (num_jobs < 1) num_jobs = 1;
+    if ((unsigned) num_jobs > total) num_jobs = total ? total : 1;
+    CarveJob *jobs = calloc(num_jobs, sizeof(*jobs));
+    pthread_t *threads = malloc(num_jobs * sizeof(*threads));
+    if (jobs == NULL || threads == NULL){
+        free(jobs);
+        free(threads);
+        free(m);
+        return -1;
+    }
+    unsigned per = (total + num_jobs - 1) / num_jobs;
+    for (int i = 0; i < num_jobs; i++){
+        jobs[i] = (CarveJob) {v, map, m, 2 + i * per, 2 + (i + 1 == num_jobs ? total : (i + 1) * per), NULL, 0, 0, 0};
+    }
+    int started = 1;
+    for (; started < num_jobs; started++){
+        if (pthread_create(&threads[started], NULL, carve_worker, &jobs[started]) != 0){
+            break;
+        }
+    }
+    for (int i = started; i < num_jobs; i++){
+        carve_worker(&jobs[i]); //threads that could not start
+    }
+    carve_worker(&jobs[0]);
+    for (int i = 1; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    //the ranges are in order, so their events joined are too
+    unsigned n = 0;
+    int failed = 0;
+    for (int i = 0; i < num_jobs; i++){
+        n += jobs[i].count;
+        failed |= jobs[i].failed;
+    }
+    Event *all = failed ? NULL : malloc((n ? n : 1) * sizeof(*all));
+    int ret = -1;
+    if (all != NULL){
+        for (int i = 0, k = 0; i < num_jobs; k += jobs[i].count, i++){
+            if (jobs[i].count) memcpy(all + k, jobs[i].events, jobs[i].count * sizeof(*all));
+        }
+        ret = pair_events(v, map, all, n, found, count);
+    }
+    for (int i = 0; i < num_jobs; i++) free(jobs[i].events);
+    free(all);
+    free(jobs);
+    free(threads);
+    free(m);
+    return ret;
+}
+
+const char *carve_extension(int type){
+    return signatures[type].extension;
+}
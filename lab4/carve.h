@@ -0,0 +1,23 @@
+#ifndef _CARVE_H_
+#define _CARVE_H_
+
+#include <stdint.h>
+#include "volume.h"
+#include "clustermap.h"
+
+//a file found by its signatures in free space; carving takes files to be contiguous
+typedef struct carved{
+    unsigned cluster;           //first cluster
+    unsigned count;             //clusters
+    uint64_t size;
+    int type;
+} Carved;
+
+//Scans the free clusters for file headers (at the start of a cluster, where FAT puts a file)
+//and the footers that end them, num_jobs threads over separate cluster ranges. *found is
+//malloc'd and in cluster order. Returns -1 if memory runs out.
+int carve_scan(const Volume *v, const ClusterMap *map, int num_jobs, Carved **found, unsigned *count);
+//file name extension for a Carved type
+const char *carve_extension(int type);
+
+#endif
@@ -0,0 +1,422 @@
+#!/bin/bash
+# Regression check for nyufile.
+# Usage: ./check.sh [nyufile binary]
+# Builds the test image with mkimage.py and runs nyufile on a fresh copy of it for every case
+# below. What a run must print is spelled out; what it leaves behind is checked by reading
+# files back with fatfile.py against the SHA-1s mkimage.py recorded, or by comparing the
+# image with the one built. Prints one line per check and exits 1 if any failed.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+bin=$(realpath "${1:-$dir/nyufile}")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+cd "$tmp" || exit 1
+python3 "$dir/mkimage.py" image || exit 1
+
+failed=0
+pass(){
+    echo "ok   $1"
+}
+fail(){
+    echo "FAIL $1"
+    failed=1
+}
+
+# SHA-1 of a file mkimage.py put on the image
+sha1(){
+    python3 -c 'import json, sys; print(next(m["sha1"] for m in json.load(open("image.json")) if m["name"] == sys.argv[1]))' "$1"
+}
+
+# byte offset of a cluster in disk
+cluster_offset(){
+    python3 -c 'import struct, sys
+b = open("disk", "rb").read(512)
+bps, spc, rsvd, nfats = struct.unpack_from("<HBHB", b, 11)
+print((rsvd + nfats * struct.unpack_from("<I", b, 36)[0] + (int(sys.argv[1]) - 2) * spc) * bps)' "$1"
+}
+
+# overwrites a few bytes of a cluster and puts the mtime back, as writing a block device
+# leaves it
+scribble(){
+    touch -r disk stamp
+    printf 'XYZ' | dd of=disk bs=1 seek=$(($(cluster_offset "$1") + 3)) conv=notrunc status=none
+    touch -r stamp disk
+}
+
+# runs nyufile on a fresh copy of the image (on the last one with KEEP=1): what it prints
+# goes to got, with control characters made visible, and its exit status to rc
+run(){
+    [ -n "$KEEP" ] || cp image disk
+    (exec -a nyufile "$bin" disk "$@") 2>&1 | cat -v > got
+    rc=${PIPESTATUS[0]}
+}
+
+# case name, exit status, then every line the last run must have printed
+prints(){
+    local name=$1 status=$2
+    shift 2
+    printf '%s\n' "$@" > want
+    if [ "$rc" = "$status" ] && cmp -s want got; then
+        pass "$name"
+    else
+        fail "$name"
+        echo "     exit status $rc"
+        diff want got | sed 's/^/     /'
+    fi
+}
+
+# case name: the last run printed the usage and failed
+usage(){
+    if [ "$rc" = 1 ] && grep -qx "Usage: nyufile disk <options>" got; then
+        pass "$1"
+    else
+        fail "$1"
+    fi
+}
+
+# case name, a path on the image and a SHA-1: the file reads back with that SHA-1 through
+# its directory entry and every FAT copy
+holds(){
+    local got_sha1
+    got_sha1=$(python3 "$dir/fatfile.py" disk "$2")
+    if [ "$got_sha1" = "$3" ]; then
+        pass "$1"
+    else
+        fail "$1"
+        echo "     $2: $got_sha1"
+    fi
+}
+
+# case name, a file and a SHA-1 it must have
+copied(){
+    local got_sha1
+    [ -f "$2" ] && got_sha1=$(sha1sum < "$2" | cut -c1-40)
+    if [ "$got_sha1" = "$3" ]; then
+        pass "$1"
+    else
+        fail "$1"
+        echo "     $2: ${got_sha1:-missing}"
+    fi
+}
+
+# case name: the last run left the image as it was built
+untouched(){
+    if cmp -s image disk; then
+        pass "$1"
+    else
+        fail "$1"
+    fi
+}
+
+run
+usage "no option prints the usage"
+run -x
+usage "an unknown option prints the usage"
+
+run -i
+prints "-i prints the geometry" 0 \
+    "Number of FATs = 2" \
+    "Number of bytes per sector = 512" \
+    "Number of sectors per cluster = 1" \
+    "Number of reserved sectors = 32"
+
+# long name entries are listed as the 8.3 entries they are stored as, as -l always has
+run -l
+prints "-l lists the root directory" 0 \
+    "NYUVOL (size = 0)" \
+    "HELLO.TXT (size = 14, starting cluster = 3)" \
+    "Ba^@m^@e^@..^@b^@ (size = -1, starting cluster = 268369920)" \
+    "^Aa^@.^@v^@ (size = 7208992, starting cluster = 7274496)" \
+    "LIVE.BIN (size = 888, starting cluster = 7)" \
+    "SUB/ (starting cluster = 40)" \
+    "F0.DAT (size = 300, starting cluster = 100)" \
+    "F1.DAT (size = 300, starting cluster = 101)" \
+    "F2.DAT (size = 300, starting cluster = 102)" \
+    "F3.DAT (size = 300, starting cluster = 103)" \
+    "F4.DAT (size = 300, starting cluster = 104)" \
+    "F5.DAT (size = 300, starting cluster = 105)" \
+    "F6.DAT (size = 300, starting cluster = 106)" \
+    "F7.DAT (size = 300, starting cluster = 107)" \
+    "Total number of entries = 14"
+untouched "-l leaves the image alone"
+
+# -r: contiguous files, by name alone and by SHA-1
+run -r FILE1.TXT
+prints "-r FILE1.TXT" 0 "FILE1.TXT: successfully recovered"
+holds "-r FILE1.TXT links its clusters" FILE1.TXT "$(sha1 FILE1.TXT)"
+run -r FILE1.TXT -s "$(sha1 FILE1.TXT)"
+prints "-r FILE1.TXT -s" 0 "FILE1.TXT: successfully recovered with SHA-1"
+holds "-r FILE1.TXT -s links its clusters" FILE1.TXT "$(sha1 FILE1.TXT)"
+run -r FILE1.TXT -s 0000000000000000000000000000000000000000
+prints "-r FILE1.TXT with another SHA-1" 0 "FILE1.TXT: file not found"
+untouched "-r FILE1.TXT with another SHA-1 changes nothing"
+run -r EMPTY.TXT
+prints "-r an empty file" 0 "EMPTY.TXT: successfully recovered"
+holds "-r an empty file restores its entry" EMPTY.TXT "$(sha1 EMPTY.TXT)"
+run -r NOPE.TXT
+prints "-r a name that is not there" 0 "NOPE.TXT: file not found"
+untouched "-r a name that is not there changes nothing"
+# DUP.TXT and XUP.TXT are both ?UP.TXT once deleted
+run -r DUP.TXT
+prints "-r with two candidates" 0 "DUP.TXT: multiple candidates found"
+untouched "-r with two candidates changes nothing"
+run -r DUP.TXT -s "$(sha1 DUP.TXT)"
+prints "-r DUP.TXT -s picks one of two" 0 "DUP.TXT: successfully recovered with SHA-1"
+holds "-r DUP.TXT -s links its clusters" DUP.TXT "$(sha1 DUP.TXT)"
+run -r XUP.TXT -s "$(sha1 XUP.TXT)"
+prints "-r XUP.TXT -s picks the other" 0 "XUP.TXT: successfully recovered with SHA-1"
+holds "-r XUP.TXT -s links its clusters" XUP.TXT "$(sha1 XUP.TXT)"
+run -r BIG.BIN -s "$(sha1 BIG.BIN)"
+prints "-r a 60-cluster file" 0 "BIG.BIN: successfully recovered with SHA-1"
+holds "-r a 60-cluster file links its clusters" BIG.BIN "$(sha1 BIG.BIN)"
+
+# -R: fragmented files, whose clusters come in another order
+run -R FRAG.BIN -s "$(sha1 FRAG.BIN)"
+prints "-R FRAG.BIN" 0 "FRAG.BIN: successfully recovered with SHA-1"
+holds "-R FRAG.BIN links its clusters in order" FRAG.BIN "$(sha1 FRAG.BIN)"
+run -R FILE1.TXT -s "$(sha1 FILE1.TXT)"
+prints "-R a contiguous file" 0 "FILE1.TXT: successfully recovered with SHA-1"
+holds "-R a contiguous file links its clusters" FILE1.TXT "$(sha1 FILE1.TXT)"
+run -R EMPTY.TXT -s "$(sha1 EMPTY.TXT)"
+prints "-R an empty file" 0 "EMPTY.TXT: successfully recovered with SHA-1"
+holds "-R an empty file restores its entry" EMPTY.TXT "$(sha1 EMPTY.TXT)"
+run -R FIVE.BIN -s "$(sha1 FIVE.BIN)"
+prints "-R a five-cluster file" 0 "FIVE.BIN: successfully recovered with SHA-1"
+holds "-R a five-cluster file links its clusters in order" FIVE.BIN "$(sha1 FIVE.BIN)"
+run -R FIVE.BIN -s 1111111111111111111111111111111111111111
+prints "-R with a SHA-1 nothing has" 0 "FIVE.BIN: file not found"
+untouched "-R with a SHA-1 nothing has changes nothing"
+
+# the whole tree: deleted entries in every directory, long names and paths
+run --list-deleted
+prints "--list-deleted lists every directory" 0 \
+    "/?ILE1.TXT (size = 847, starting cluster = 4)" \
+    "/?MPTY.TXT (size = 0)" \
+    "/?RAG.BIN (size = 1847, starting cluster = 6)" \
+    "/deleted long file.txt [FILE2.TXT] (size = 301, starting cluster = 10)" \
+    "/?UP.TXT (size = 328, starting cluster = 12)" \
+    "/?UP.TXT (size = 405, starting cluster = 13)" \
+    "/?ONE/ (starting cluster = 60)" \
+    "/?IG.BIN (size = 30519, starting cluster = 200)" \
+    "/?IGFRAG.BIN (size = 3441, starting cluster = 400)" \
+    "/?IVE.BIN (size = 2537, starting cluster = 15)" \
+    "/?EROS.BIN (size = 1636, starting cluster = 500)" \
+    "/?RAP.BIN (size = 8192, starting cluster = 268435440)" \
+    "/SUB/inner deleted.txt [INNER.TXT] (size = 314, starting cluster = 42)" \
+    "/SUB/DEEP/?EEPDEL.JPG (size = 606, starting cluster = 44)" \
+    "Total number of deleted entries = 14"
+untouched "--list-deleted leaves the image alone"
+run -r "deleted long file.txt"
+prints "-r by long name" 0 "deleted long file.txt: successfully recovered"
+holds "-r by long name links its clusters" FILE2.TXT "$(sha1 FILE2.TXT)"
+run -r SUB/INNER.TXT
+prints "-r in a subdirectory" 0 "SUB/INNER.TXT: successfully recovered"
+holds "-r in a subdirectory links its clusters" SUB/INNER.TXT "$(sha1 INNER.TXT)"
+run -R "SUB/inner deleted.txt" -s "$(sha1 INNER.TXT)"
+prints "-R by long name in a subdirectory" 0 "SUB/inner deleted.txt: successfully recovered with SHA-1"
+holds "-R by long name in a subdirectory links its clusters" SUB/INNER.TXT "$(sha1 INNER.TXT)"
+
+# -j: the search finds the same chain on one thread as on many
+for j in 1 2 16; do
+    run -R FRAG.BIN -s "$(sha1 FRAG.BIN)" -j $j
+    prints "-R FRAG.BIN -j $j" 0 "FRAG.BIN: successfully recovered with SHA-1"
+    holds "-R FRAG.BIN -j $j links its clusters in order" FRAG.BIN "$(sha1 FRAG.BIN)"
+    run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" -j $j
+    prints "-R FIVE.BIN -j $j" 0 "FIVE.BIN: successfully recovered with SHA-1"
+    holds "-R FIVE.BIN -j $j links its clusters in order" FIVE.BIN "$(sha1 FIVE.BIN)"
+done
+run -R FIVE.BIN -s 1111111111111111111111111111111111111111 -j 16
+prints "-R -j 16 with a SHA-1 nothing has" 0 "FIVE.BIN: file not found"
+untouched "-R -j 16 with a SHA-1 nothing has changes nothing"
+
+# --depth and --window bound the search: BIGFRAG.BIN is seven clusters, FIVE.BIN ends six
+# clusters past its first
+run -R BIGFRAG.BIN -s "$(sha1 BIGFRAG.BIN)"
+prints "-R past the default depth" 0 "BIGFRAG.BIN: file not found"
+untouched "-R past the default depth changes nothing"
+run -R BIGFRAG.BIN -s "$(sha1 BIGFRAG.BIN)" --depth 7
+prints "-R --depth 7" 0 "BIGFRAG.BIN: successfully recovered with SHA-1"
+holds "-R --depth 7 links seven clusters in order" BIGFRAG.BIN "$(sha1 BIGFRAG.BIN)"
+run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" --window 5
+prints "-R with a window that misses a cluster" 0 "FIVE.BIN: file not found"
+untouched "-R with a window that misses a cluster changes nothing"
+run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" --window 6
+prints "-R --window 6" 0 "FIVE.BIN: successfully recovered with SHA-1"
+holds "-R --window 6 links its clusters in order" FIVE.BIN "$(sha1 FIVE.BIN)"
+
+# pruning: only free clusters are candidates, but a free cluster of zeros is still one
+run -R ZEROS.BIN -s "$(sha1 ZEROS.BIN)"
+prints "-R a file with clusters of zeros" 0 "ZEROS.BIN: successfully recovered with SHA-1"
+holds "-R a file with clusters of zeros links them in order" ZEROS.BIN "$(sha1 ZEROS.BIN)"
+run -R FRAG.BIN -s "$(sha1 FRAG.BIN)"
+holds "-R FRAG.BIN leaves LIVE.BIN, between its clusters, alone" LIVE.BIN "$(sha1 LIVE.BIN)"
+
+# -o copies out and leaves the image alone
+run -r FILE1.TXT -o out
+prints "-r -o" 0 "FILE1.TXT: successfully recovered to FILE1.TXT"
+copied "-r -o writes the file" out/FILE1.TXT "$(sha1 FILE1.TXT)"
+untouched "-r -o leaves the image alone"
+rm -rf out
+run -R FRAG.BIN -s "$(sha1 FRAG.BIN)" -o out
+prints "-R -o" 0 "FRAG.BIN: successfully recovered with SHA-1 to FRAG.BIN"
+copied "-R -o writes the file in order" out/FRAG.BIN "$(sha1 FRAG.BIN)"
+untouched "-R -o leaves the image alone"
+rm -rf out
+
+# --all takes every deleted file as contiguous; -o names them after their entries, with the
+# deleted first letter as _ and a suffix when two collide
+run --all -o out
+prints "--all -o" 0 \
+    "/?ILE1.TXT: successfully recovered to _ILE1.TXT" \
+    "/?MPTY.TXT: successfully recovered to _MPTY.TXT" \
+    "/?RAG.BIN: successfully recovered to _RAG.BIN" \
+    "/deleted long file.txt: successfully recovered to deleted long file.txt" \
+    "/?UP.TXT: successfully recovered to _UP.TXT" \
+    "/?UP.TXT: successfully recovered to _UP.TXT.1" \
+    "/?IG.BIN: successfully recovered to _IG.BIN" \
+    "/?IGFRAG.BIN: successfully recovered to _IGFRAG.BIN" \
+    "/?IVE.BIN: successfully recovered to _IVE.BIN" \
+    "/?EROS.BIN: successfully recovered to _EROS.BIN" \
+    "/SUB/inner deleted.txt: successfully recovered to SUB/inner deleted.txt" \
+    "/SUB/DEEP/?EEPDEL.JPG: successfully recovered to SUB/DEEP/_EEPDEL.JPG"
+copied "--all -o writes FILE1.TXT" out/_ILE1.TXT "$(sha1 FILE1.TXT)"
+copied "--all -o writes EMPTY.TXT" out/_MPTY.TXT "$(sha1 EMPTY.TXT)"
+copied "--all -o writes a long-named file" "out/deleted long file.txt" "$(sha1 FILE2.TXT)"
+copied "--all -o writes DUP.TXT" out/_UP.TXT "$(sha1 DUP.TXT)"
+copied "--all -o writes XUP.TXT beside it" out/_UP.TXT.1 "$(sha1 XUP.TXT)"
+copied "--all -o writes BIG.BIN" out/_IG.BIN "$(sha1 BIG.BIN)"
+copied "--all -o writes into subdirectories" "out/SUB/inner deleted.txt" "$(sha1 INNER.TXT)"
+untouched "--all -o leaves the image alone"
+rm -rf out
+# in place, a file whose clusters another one holds is left deleted
+run --all
+prints "--all" 0 \
+    "/?ILE1.TXT: successfully recovered" \
+    "/?MPTY.TXT: successfully recovered" \
+    "/?RAG.BIN: clusters already in use" \
+    "/deleted long file.txt: successfully recovered" \
+    "/?UP.TXT: successfully recovered" \
+    "/?UP.TXT: successfully recovered" \
+    "/?IG.BIN: successfully recovered" \
+    "/?IGFRAG.BIN: successfully recovered" \
+    "/?IVE.BIN: successfully recovered" \
+    "/?EROS.BIN: successfully recovered" \
+    "/SUB/inner deleted.txt: successfully recovered" \
+    "/SUB/DEEP/?EEPDEL.JPG: successfully recovered"
+holds "--all links FILE1.TXT" _ILE1.TXT "$(sha1 FILE1.TXT)"
+holds "--all links BIG.BIN" _IG.BIN "$(sha1 BIG.BIN)"
+holds "--all links into subdirectories, the first letter from the long name" SUB/INNER.TXT "$(sha1 INNER.TXT)"
+holds "--all leaves LIVE.BIN alone" LIVE.BIN "$(sha1 LIVE.BIN)"
+holds "--all leaves FRAG.BIN deleted" _RAG.BIN missing
+
+# --list: names, each with an optional SHA-1 as sha1sum prints it
+printf '%s  FILE1.TXT\nDUP.TXT\n%s  FIVE.BIN\n' "$(sha1 FILE1.TXT)" "$(sha1 FIVE.BIN)" > list
+run --list - < list
+prints "--list" 0 \
+    "FILE1.TXT: successfully recovered with SHA-1" \
+    "DUP.TXT: multiple candidates found" \
+    "FIVE.BIN: successfully recovered with SHA-1"
+holds "--list links FILE1.TXT" FILE1.TXT "$(sha1 FILE1.TXT)"
+holds "--list links FIVE.BIN in order" FIVE.BIN "$(sha1 FIVE.BIN)"
+holds "--list leaves DUP.TXT deleted" DUP.TXT missing
+
+# WRAP.BIN's entry starts near 2^28 clusters: sums over it must not wrap back into the volume
+run -r WRAP.BIN
+prints "-r a start cluster past the volume" 0 "WRAP.BIN: file not found"
+untouched "-r a start cluster past the volume changes nothing"
+run -R WRAP.BIN -s 0000000000000000000000000000000000000000
+prints "-R a start cluster past the volume" 0 "WRAP.BIN: file not found"
+untouched "-R a start cluster past the volume changes nothing"
+run -R WRAP.BIN -s 0000000000000000000000000000000000000000 -o out
+prints "-R -o a start cluster past the volume" 0 "WRAP.BIN: file not found"
+if [ ! -e out/WRAP.BIN ]; then
+    pass "-R -o a start cluster past the volume writes nothing"
+else
+    fail "-R -o a start cluster past the volume writes nothing"
+fi
+rm -rf out
+
+# an in-place recovery saves what it overwrites with --journal, and --rollback puts it back
+run -R FRAG.BIN -s "$(sha1 FRAG.BIN)" --journal journal
+prints "-R --journal" 0 "FRAG.BIN: successfully recovered with SHA-1"
+holds "-R --journal links its clusters in every FAT" FRAG.BIN "$(sha1 FRAG.BIN)"
+KEEP=1 run --rollback journal
+prints "--rollback" 0 "journal: rolled back"
+untouched "--rollback restores the image"
+rm -f journal
+run --all --journal journal
+KEEP=1 run --rollback journal
+prints "--rollback after --all" 0 "journal: rolled back"
+untouched "--rollback after --all restores the image"
+rm -f journal
+run --rollback journal
+prints "--rollback without a journal" 1 "journal: No such file or directory"
+untouched "--rollback without a journal changes nothing"
+
+# --cache keeps digests between runs, but what gets recovered is always hashed again
+run -r FILE1.TXT -s "$(sha1 FILE1.TXT)" -o out --cache cache
+prints "-r --cache" 0 "FILE1.TXT: successfully recovered with SHA-1 to FILE1.TXT"
+rm -rf out
+KEEP=1 run -r FILE1.TXT -s "$(sha1 FILE1.TXT)" -o out --cache cache
+prints "-r --cache from a cached digest" 0 "FILE1.TXT: successfully recovered with SHA-1 to FILE1.TXT"
+copied "-r --cache from a cached digest writes the file" out/FILE1.TXT "$(sha1 FILE1.TXT)"
+rm -rf out
+scribble 5
+KEEP=1 run -r FILE1.TXT -s "$(sha1 FILE1.TXT)" -o out --cache cache
+prints "-r --cache after the run changed under the same mtime" 0 "FILE1.TXT: file not found"
+rm -rf out cache
+# both ?UP.TXT runs are hashed looking for DUP.TXT; the cache then rules DUP.TXT's out for XUP.TXT
+run -r DUP.TXT -s "$(sha1 DUP.TXT)" -o out --cache cache
+rm -rf out
+KEEP=1 run -r XUP.TXT -s "$(sha1 XUP.TXT)" -o out --cache cache
+prints "-r --cache picks the other candidate" 0 "XUP.TXT: successfully recovered with SHA-1 to XUP.TXT"
+copied "-r --cache picks the other candidate's data" out/XUP.TXT "$(sha1 XUP.TXT)"
+rm -rf out cache
+run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" -o out --cache cache
+prints "-R --cache" 0 "FIVE.BIN: successfully recovered with SHA-1 to FIVE.BIN"
+rm -rf out
+KEEP=1 run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" -o out --cache cache
+prints "-R --cache from a cached search" 0 "FIVE.BIN: successfully recovered with SHA-1 to FIVE.BIN"
+copied "-R --cache from a cached search writes the file in order" out/FIVE.BIN "$(sha1 FIVE.BIN)"
+rm -rf out
+scribble 19
+KEEP=1 run -R FIVE.BIN -s "$(sha1 FIVE.BIN)" -o out --cache cache
+prints "-R --cache after a candidate changed under the same mtime" 0 "FIVE.BIN: file not found"
+rm -rf out cache
+
+# --carve finds files by their signatures in free clusters, directory entry or not. DEEPDEL.JPG
+# starts like a JPEG but has no valid segments; carve.jpg has an EXIF thumbnail with an end
+# marker of its own; carve.zip holds a stored ZIP whose end record comes first; album.zip
+# stores a JPEG that starts on a cluster boundary, and is carved whole.
+run --carve
+usage "--carve without -o prints the usage"
+run --carve -o out
+prints "--carve -o" 0 \
+    "00000300.png: carved 716 bytes from clusters 300-301" \
+    "00000310.pdf: carved 416 bytes from clusters 310-310" \
+    "00000320.jpg: carved 1110 bytes from clusters 320-322" \
+    "00000600.zip: carved 1166 bytes from clusters 600-602" \
+    "00000620.zip: carved 1325 bytes from clusters 620-622" \
+    "Total number of carved files = 5"
+copied "--carve ends a PNG at IEND" out/00000300.png "$(sha1 carve.png)"
+copied "--carve ends a PDF after its %%EOF line" out/00000310.pdf "$(sha1 carve.pdf)"
+copied "--carve ends a JPEG at its own end marker, not its thumbnail's" out/00000320.jpg "$(sha1 carve.jpg)"
+copied "--carve ends a ZIP at its own end record" out/00000600.zip "$(sha1 carve.zip)"
+copied "--carve passes over a file stored in a ZIP" out/00000620.zip "$(sha1 album.zip)"
+printf '%s\n' "00000300.png 716 300-301" "00000310.pdf 416 310-310" "00000320.jpg 1110 320-322" \
+    "00000600.zip 1166 600-602" "00000620.zip 1325 620-622" > want
+if cmp -s want out/carve.map; then
+    pass "--carve writes the cluster map"
+else
+    fail "--carve writes the cluster map"
+fi
+untouched "--carve leaves the image alone"
+rm -rf out
+for j in 1 16; do
+    run --carve -o out -j $j
+    copied "--carve -j $j finds the JPEG" out/00000320.jpg "$(sha1 carve.jpg)"
+    copied "--carve -j $j finds the ZIP" out/00000600.zip "$(sha1 carve.zip)"
+    rm -rf out
+done
+
+exit $failed
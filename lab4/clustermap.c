@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <string.h>
+#include "clustermap.h"
+
+//returns -1 on allocation failure
+int cluster_map_build(ClusterMap *m, const Volume *v){
+    unsigned end = v->num_clusters + 2;
+    m->v = v;
+    m->num_free = 0;
+    m->free = calloc((end + 63) / 64, sizeof(*m->free));
+    m->fingerprints = calloc(end, sizeof(*m->fingerprints));
+    if (m->free == NULL || m->fingerprints == NULL){
+        cluster_map_free(m);
+        return -1;
+    }
+    //64 FAT entries per bitmap word
+    const uint32_t *fat = v->fat;
+    for (unsigned base = 0; base < end; base += 64){
+        uint64_t bits = 0;
+        unsigned n = end - base < 64 ? end - base : 64;
+        for (unsigned i = 0; i < n; i++){
+            bits |= (uint64_t) ((fat[base + i] & FAT_MASK) == 0) << i;
+        }
+        m->free[base / 64] = bits;
+        m->num_free += __builtin_popcountll(bits);
+    }
+    m->free[0] &= ~(uint64_t) 3; //clusters 0 and 1 are not data
+    m->num_free -= (fat[0] & FAT_MASK) == 0;
+    m->num_free -= (fat[1] & FAT_MASK) == 0;
+    return 0;
+}
+
+void cluster_map_free(ClusterMap *m){
+    free(m->free);
+    free(m->fingerprints);
+    m->free = NULL;
+    m->fingerprints = NULL;
+}
+
+//64-bit multiply-xor hash of the cluster, FP_EMPTY if it is all zeroes
+uint64_t cluster_fingerprint(ClusterMap *m, VolumeCursor *c, unsigned cluster){
+    if (m->fingerprints[cluster] != FP_UNKNOWN){
+        return m->fingerprints[cluster];
+    }
+    const char *p = cursor_cluster(c, cluster);
+    uint64_t h = 0x9E3779B97F4A7C15ull, any = 0;
+    for (unsigned i = 0; i < m->v->bytes_per_cluster; i += sizeof(uint64_t)){
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        any |= w;
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    h = any == 0 ? FP_EMPTY : h | 2;
+    m->fingerprints[cluster] = h;
+    return h;
+}
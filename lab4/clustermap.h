@@ -0,0 +1,28 @@
+#ifndef _CLUSTERMAP_H_
+#define _CLUSTERMAP_H_
+
+#include <stdint.h>
+#include "volume.h"
+
+#define FP_UNKNOWN 0            //fingerprint not computed yet
+#define FP_EMPTY 1              //cluster is all zero bytes
+
+//what recovery needs to know about every cluster: free or not (from one pass over the FAT),
+//and a content fingerprint, computed the first time it is asked for
+typedef struct cluster_map{
+    const Volume *v;
+    uint64_t *free;             //bit per cluster number
+    unsigned num_free;
+    uint64_t *fingerprints;     //per cluster number
+} ClusterMap;
+
+int cluster_map_build(ClusterMap *m, const Volume *v);
+void cluster_map_free(ClusterMap *m);
+//reads the cluster through c if it has not been fingerprinted yet
+uint64_t cluster_fingerprint(ClusterMap *m, VolumeCursor *c, unsigned cluster);
+
+static inline int cluster_free(const ClusterMap *m, unsigned cluster){
+    return (m->free[cluster / 64] >> (cluster % 64)) & 1;
+}
+
+#endif
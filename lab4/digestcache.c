@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "digestcache.h"
+
+#define CACHE_MAGIC "NYUDGST1"
+
+//the file is stale once the image has been written by anything else: nyufile saves it again
+//after changing the image itself, and only ever changes the FATs and directory entries. A block
+//device keeps its mtime when written, so callers check what they restore: a cached run digest
+//is hashed again when it matches, and -R searches key entries by content as well.
+typedef struct cache_header{
+    char magic[8];
+    uint32_t volume_id;
+    uint32_t count;
+    uint64_t volume_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} CacheHeader;
+
+void cache_init(DigestCache *c, const Volume *v){
+    memset(c, 0, sizeof(*c));
+    c->v = v;
+}
+
+void cache_free(DigestCache *c){
+    free(c->entries);
+    free(c->blob);
+    cache_init(c, c->v);
+}
+
+uint64_t cache_hash(const void *p, size_t len){
+    const unsigned char *b = p;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++){
+        h = (h ^ b[i]) * 0x100000001b3ull;
+    }
+    return h | 1;
+}
+
+static CacheEntry *slot(const DigestCache *c, uint64_t hash, const void *key, uint32_t key_len){
+    for (unsigned i = hash & c->mask; ; i = (i + 1) & c->mask){
+        CacheEntry *e = &c->entries[i];
+        if (e->hash == 0 || (e->hash == hash && e->key_len == key_len && memcmp(c->blob + e->offset, key, key_len) == 0)){
+            return e;
+        }
+    }
+}
+
+const void *cache_get(const DigestCache *c, const void *key, uint32_t key_len, uint32_t *val_len){
+    if (c->entries == NULL){
+        return NULL;
+    }
+    CacheEntry *e = slot(c, cache_hash(key, key_len), key, key_len);
+    if (e->hash == 0){
+        return NULL;
+    }
+    *val_len = e->val_len;
+    return c->blob + e->offset + e->key_len;
+}
+
+//keeps the table at most half full
+static int cache_grow(DigestCache *c){
+    if (c->entries != NULL && (c->count + 1) * 2 <= c->mask + 1){
+        return 0;
+    }
+    unsigned size = c->entries ? (c->mask + 1) * 2 : 1024;
+    CacheEntry *old = c->entries;
+    unsigned old_size = c->entries ? c->mask + 1 : 0;
+    c->entries = calloc(size, sizeof(*c->entries));
+    if (c->entries == NULL){
+        c->entries = old;
+        return -1;
+    }
+    c->mask = size - 1;
+    for (unsigned i = 0; i < old_size; i++){
+        if (old[i].hash != 0){
+            *slot(c, old[i].hash, c->blob + old[i].offset, old[i].key_len) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+int cache_put(DigestCache *c, const void *key, uint32_t key_len, const void *val, uint32_t val_len){
+    if (cache_grow(c) == -1){
+        return -1;
+    }
+    uint64_t hash = cache_hash(key, key_len);
+    CacheEntry *e = slot(c, hash, key, key_len);
+    if (e->hash != 0 && e->val_len == val_len){
+        memcpy(c->blob + e->offset + key_len, val, val_len);
+        c->dirty = 1;
+        return 0;
+    }
+    size_t need = c->blob_len + key_len + val_len;
+    if (need > c->blob_cap){
+        size_t cap = c->blob_cap ? c->blob_cap : 4096;
+        while (cap < need) cap *= 2;
+        char *p = realloc(c->blob, cap);
+        if (p == NULL){
+            return -1;
+        }
+        c->blob = p;
+        c->blob_cap = cap;
+    }
+    if (e->hash == 0){
+        c->count++;
+    }
+    *e = (CacheEntry) {hash, c->blob_len, key_len, val_len};
+    memcpy(c->blob + c->blob_len, key, key_len);
+    memcpy(c->blob + c->blob_len + key_len, val, val_len);
+    c->blob_len = need;
+    c->dirty = 1;
+    return 0;
+}
+
+static int header_for(const DigestCache *c, CacheHeader *h){
+    struct stat sb;
+    if (fstat(c->v->fd, &sb) == -1){
+        return -1;
+    }
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+    h->volume_id = c->v->boot.BS_VolID;
+    h->count = c->count;
+    h->volume_size = c->v->size;
+    h->mtime_sec = sb.st_mtim.tv_sec;
+    h->mtime_nsec = sb.st_mtim.tv_nsec;
+    return 0;
+}
+
+int cache_load(DigestCache *c, const char *path){
+    FILE *f = fopen(path, "rb");
+    if (f == NULL){
+        return 0;
+    }
+    CacheHeader h, want;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && header_for(c, &want) == 0;
+    want.count = h.count;
+    ok = ok && memcmp(&h, &want, sizeof(h)) == 0;
+
+    //records are {key_len, val_len, key, value}, then a hash of everything before it
+    uint64_t sum = cache_hash(&h, sizeof(h));
+    int ret = 0;
+    for (uint32_t i = 0; ok && i < h.count; i++){
+        uint32_t lens[2];
+        char buf[1024];
+        ok = fread(lens, sizeof(lens), 1, f) == 1 && lens[0] + (uint64_t) lens[1] <= sizeof(buf)
+            && fread(buf, lens[0] + lens[1], 1, f) == 1;
+        if (ok){
+            sum = cache_hash(&sum, sizeof(sum)) ^ cache_hash(lens, sizeof(lens)) ^ cache_hash(buf, lens[0] + lens[1]);
+            if (cache_put(c, buf, lens[0], buf + lens[0], lens[1]) == -1){
+                ret = -1;
+                break;
+            }
+        }
+    }
+    uint64_t stored;
+    if (ret == -1 || !ok || fread(&stored, sizeof(stored), 1, f) != 1 || stored != sum){
+        cache_free(c);
+    }
+    c->dirty = 0;
+    fclose(f);
+    return ret;
+}
+
+int cache_save(DigestCache *c, const char *path){
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    CacheHeader h;
+    if (header_for(c, &h) == -1){
+        return -1;
+    }
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL){
+        return -1;
+    }
+    uint64_t sum = cache_hash(&h, sizeof(h));
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (unsigned i = 0; ok && c->entries != NULL && i <= c->mask; i++){
+        const CacheEntry *e = &c->entries[i];
+        if (e->hash == 0){
+            continue;
+        }
+        uint32_t lens[2] = {e->key_len, e->val_len};
+        sum = cache_hash(&sum, sizeof(sum)) ^ cache_hash(lens, sizeof(lens)) ^ cache_hash(c->blob + e->offset, e->key_len + e->val_len);
+        ok = fwrite(lens, sizeof(lens), 1, f) == 1 && fwrite(c->blob + e->offset, e->key_len + e->val_len, 1, f) == 1;
+    }
+    ok = ok && fwrite(&sum, sizeof(sum), 1, f) == 1;
+    if (fclose(f) != 0 || !ok || rename(tmp, path) == -1){
+        unlink(tmp);
+        return -1;
+    }
+    c->dirty = 0;
+    return 0;
+}
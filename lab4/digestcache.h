@@ -0,0 +1,43 @@
+#ifndef _DIGESTCACHE_H_
+#define _DIGESTCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "volume.h"
+
+//one key/value pair, both kept in DigestCache.blob
+typedef struct cache_entry{
+    uint64_t hash;              //0 marks an empty slot
+    size_t offset;              //key_len bytes of key, then val_len bytes of value
+    uint32_t key_len;
+    uint32_t val_len;
+} CacheEntry;
+
+//hashing results worth keeping between runs on the same image (digests of cluster runs,
+//outcomes of -R searches), keyed by whatever produced them. Only ever used by one thread.
+typedef struct digest_cache{
+    const Volume *v;
+    CacheEntry *entries;        //open addressing
+    unsigned count;
+    unsigned mask;              //table size - 1
+    char *blob;
+    size_t blob_len;
+    size_t blob_cap;
+    int dirty;                  //added to since it was loaded
+} DigestCache;
+
+void cache_init(DigestCache *c, const Volume *v);
+void cache_free(DigestCache *c);
+//a file that is missing, damaged or written for another state of the image loads as empty;
+//returns -1 only on allocation failure
+int cache_load(DigestCache *c, const char *path);
+//replaces the file in one rename; returns -1 on error
+int cache_save(DigestCache *c, const char *path);
+
+//NULL when key is absent. The value stays valid until the next cache_put.
+const void *cache_get(const DigestCache *c, const void *key, uint32_t key_len, uint32_t *val_len);
+int cache_put(DigestCache *c, const void *key, uint32_t key_len, const void *val, uint32_t val_len);
+
+uint64_t cache_hash(const void *p, size_t len);
+
+#endif
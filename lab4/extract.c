@@ -0,0 +1,130 @@
+#define _GNU_SOURCE //copy_file_range
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "extract.h"
+
+#define MAX_SUFFIX 1000
+
+//keeps path inside the output directory: no leading '/', no "." or ".." components, and no
+//'?' (what a lost first letter shows as)
+static int relative_path(const char *path, char *out, size_t len){
+    size_t o = 0;
+    while (*path != '\0'){
+        while (*path == '/') path++;
+        size_t n = strcspn(path, "/");
+        if (n == 0 || (n == 1 && path[0] == '.')){
+            path += n;
+            continue;
+        }
+        if (o + n + 2 > len){
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (o > 0) out[o++] = '/';
+        if (n == 2 && path[0] == '.' && path[1] == '.'){
+            memcpy(out + o, "__", 2);
+        }else{
+            for (size_t i = 0; i < n; i++) out[o + i] = path[i] == '?' ? '_' : path[i];
+        }
+        o += n;
+        path += n;
+    }
+    if (o == 0){
+        errno = EINVAL;
+        return -1;
+    }
+    out[o] = '\0';
+    return 0;
+}
+
+static int make_parents(int dir, char *path){
+    for (char *slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/')){
+        *slash = '\0';
+        int ret = mkdirat(dir, path, 0755);
+        *slash = '/';
+        if (ret == -1 && errno != EEXIST){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//data-region bytes [offset, offset + len) to the end of fd: copy_file_range keeps them in
+//the kernel, and writing from a cursor's windows covers filesystems it cannot handle
+static int copy_range(const Volume *v, int fd, uint64_t offset, uint64_t len){
+    off64_t in = v->data_offset + offset;
+    while (len > 0){
+        ssize_t n = copy_file_range(v->fd, &in, fd, NULL, len, 0);
+        if (n > 0){
+            len -= n;
+            continue;
+        }
+        if (n == 0 || (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)){
+            if (n == 0) errno = EIO;
+            return -1;
+        }
+        break;
+    }
+    offset = in - v->data_offset;
+    VolumeCursor cur;
+    cursor_open(&cur, v, MADV_SEQUENTIAL);
+    while (len > 0){
+        uint64_t room = WINDOW_SIZE - (offset & (WINDOW_SIZE - 1));
+        ssize_t n = write(fd, cursor_data(&cur, offset), len < room ? len : room);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            cursor_close(&cur);
+            return -1;
+        }
+        offset += n;
+        len -= n;
+    }
+    cursor_close(&cur);
+    return 0;
+}
+
+int extract_file(const Volume *v, int out_dir, const char *path, const unsigned *clusters,
+                 unsigned count, unsigned size, char *written, size_t written_len){
+    char rel[4096];
+    if (relative_path(path, rel, sizeof(rel)) == -1 || make_parents(out_dir, rel) == -1){
+        return -1;
+    }
+    int fd = -1;
+    for (int k = 0; fd == -1 && k < MAX_SUFFIX; k++){
+        if (k == 0){
+            snprintf(written, written_len, "%s", rel);
+        }else{
+            snprintf(written, written_len, "%s.%d", rel, k);
+        }
+        fd = openat(out_dir, written, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd == -1 && errno != EEXIST){
+            return -1;
+        }
+    }
+    if (fd == -1){
+        return -1;
+    }
+
+    //consecutive clusters go out as one range
+    uint64_t left = size;
+    for (unsigned i = 0; i < count && left > 0; ){
+        unsigned j = i + 1;
+        while (j < count && clusters[j] == clusters[j - 1] + 1) j++;
+        uint64_t len = (uint64_t) (j - i) << v->cluster_shift;
+        if (len > left) len = left;
+        if (copy_range(v, fd, volume_cluster_offset(v, clusters[i]), len) == -1){
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        left -= len;
+        i = j;
+    }
+    return close(fd);
+}
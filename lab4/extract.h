@@ -0,0 +1,14 @@
+#ifndef _EXTRACT_H_
+#define _EXTRACT_H_
+
+#include <stddef.h>
+#include "volume.h"
+
+//Writes the `size` bytes held by clusters[0 .. count) to `path` under the directory out_dir,
+//creating directories on the way. An existing file is never replaced; ".1", ".2", ... is added
+//to the name instead, and the name used is left in written. The image is only read.
+//Returns 0, or -1 with errno set.
+int extract_file(const Volume *v, int out_dir, const char *path, const unsigned *clusters,
+                 unsigned count, unsigned size, char *written, size_t written_len);
+
+#endif
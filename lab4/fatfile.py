@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Reads a file back from a FAT32 image the way a file system would, for check.sh.
+# Usage: python3 fatfile.py image PATH
+# Follows PATH (8.3 names, / between directories) from the root through live entries, then
+# the file's cluster chain in the FAT, and prints the SHA-1 of its contents. Prints
+# "missing" when there is no live entry, "FATs differ" when the FAT copies disagree on the
+# chain and "bad chain" when it ends before the file does.
+import struct, sys, hashlib
+
+img = open(sys.argv[1], 'rb').read()
+bps, spc, rsvd, nfats = struct.unpack_from('<HBHB', img, 11)
+fatsz, root = struct.unpack_from('<II', img, 36)[0], struct.unpack_from('<I', img, 44)[0]
+cs = bps * spc
+data = (rsvd + nfats * fatsz) * bps
+nclus = (len(img) - data) // cs
+
+def fat(copy, c):
+    return struct.unpack_from('<I', img, (rsvd + copy * fatsz) * bps + 4 * c)[0] & 0x0fffffff
+
+def chain(start):
+    out, c = [], start
+    while 2 <= c < nclus + 2 and len(out) <= nclus:
+        out.append(c)
+        nxt = {fat(i, c) for i in range(nfats)}
+        if len(nxt) != 1:
+            print('FATs differ')
+            sys.exit(0)
+        c = nxt.pop()
+    return out
+
+def read(start, size):
+    return b''.join(img[data + (c - 2) * cs:data + (c - 1) * cs] for c in chain(start))[:size]
+
+def entries(start):
+    raw = read(start, 1 << 30)
+    for o in range(0, len(raw), 32):
+        e = raw[o:o + 32]
+        if e[0] == 0:
+            return
+        if e[0] == 0xE5 or e[11] == 0x0F:
+            continue
+        base, ext = e[0:8].decode('latin-1').rstrip(), e[8:11].decode('latin-1').rstrip()
+        hi, lo = struct.unpack_from('<H', e, 20)[0], struct.unpack_from('<H', e, 26)[0]
+        yield base + ('.' + ext if ext else ''), e[11], (hi << 16 | lo) & 0x0fffffff, struct.unpack_from('<I', e, 28)[0]
+
+cluster, size = root, None
+for part in sys.argv[2].split('/'):
+    found = next((x for x in entries(cluster) if x[0] == part), None)
+    if found is None:
+        print('missing')
+        sys.exit(0)
+    cluster, size = found[2], found[3]
+content = read(cluster, size) if size else b''
+print(hashlib.sha1(content).hexdigest() if len(content) == size else 'bad chain')
@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fileindex.h"
+
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_LFN 0x0F           //low six attribute bits of a long-name slot
+#define LFN_LAST 0x40           //sequence flag on the first slot stored (the name's tail)
+#define LFN_SLOT_CHARS 13
+#define LFN_MAX_SLOTS 20        //255 characters
+
+//characters allowed in an 8.3 name, tried in turn to rebuild a deleted entry's first letter
+static const char short_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&'()-@^_`{}~";
+
+//long-name slots seen since the last short entry
+typedef struct lfn{
+    uint16_t chars[LFN_MAX_SLOTS * LFN_SLOT_CHARS];
+    int slots;
+    int deleted;
+    unsigned char checksum;
+} Lfn;
+
+//a directory still to be walked
+typedef struct pending{
+    unsigned cluster;
+    size_t path;
+} Pending;
+
+static unsigned char lfn_checksum(const unsigned char *name){
+    unsigned char sum = 0;
+    for (int i = 0; i < 11; i++){
+        sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    }
+    return sum;
+}
+
+//slots are stored last piece first, so each new slot goes in front of what we have
+static void lfn_add(Lfn *l, const unsigned char *e){
+    static const int at[LFN_SLOT_CHARS] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+    int deleted = e[0] == DIR_DELETED;
+    if ((!deleted && (e[0] & LFN_LAST)) || l->slots == LFN_MAX_SLOTS
+        || (l->slots && (e[13] != l->checksum || deleted != l->deleted))){
+        l->slots = 0;
+    }
+    memmove(l->chars + LFN_SLOT_CHARS, l->chars, l->slots * LFN_SLOT_CHARS * sizeof(*l->chars));
+    for (int i = 0; i < LFN_SLOT_CHARS; i++){
+        l->chars[i] = e[at[i]] | e[at[i] + 1] << 8;
+    }
+    l->slots++;
+    l->deleted = deleted;
+    l->checksum = e[13];
+}
+
+//UCS-2 to UTF-8, out holds at least 3 bytes per character plus the NUL
+static void lfn_utf8(const Lfn *l, char *out){
+    unsigned char *o = (unsigned char *) out;
+    for (int i = 0; i < l->slots * LFN_SLOT_CHARS; i++){
+        unsigned c = l->chars[i];
+        if (c == 0x0000 || c == 0xFFFF){
+            break;
+        }else if (c < 0x80){
+            *o++ = c;
+        }else if (c < 0x800){
+            *o++ = 0xC0 | c >> 6;
+            *o++ = 0x80 | (c & 0x3F);
+        }else{
+            *o++ = 0xE0 | c >> 12;
+            *o++ = 0x80 | ((c >> 6) & 0x3F);
+            *o++ = 0x80 | (c & 0x3F);
+        }
+    }
+    *o = '\0';
+}
+
+//reserves len bytes plus a NUL in the name pool, copying s in unless it is NULL;
+//returns the offset, or 0 on allocation failure
+static size_t names_push(FileIndex *idx, const char *s, size_t len){
+    size_t need = idx->names_len + len + 1;
+    if (need > idx->names_cap){
+        size_t cap = idx->names_cap ? idx->names_cap : 4096;
+        while (cap < need) cap *= 2;
+        char *names = realloc(idx->names, cap);
+        if (names == NULL){
+            return 0;
+        }
+        idx->names = names;
+        idx->names_cap = cap;
+    }
+    size_t offset = idx->names_len;
+    if (s != NULL){
+        memcpy(idx->names + offset, s, len);
+    }
+    idx->names[offset + len] = '\0';
+    idx->names_len = need;
+    return offset;
+}
+
+//"<parent path>/<name>", where the parent path is itself in the pool
+static size_t names_path(FileIndex *idx, size_t parent, const char *name){
+    size_t parent_len = strlen(idx->names + parent);
+    size_t len = strlen(name);
+    size_t offset = names_push(idx, NULL, parent_len + 1 + len);
+    if (offset == 0){
+        return 0;
+    }
+    memcpy(idx->names + offset, idx->names + parent, parent_len);
+    idx->names[offset + parent_len] = '/';
+    memcpy(idx->names + offset + parent_len + 1, name, len);
+    return offset;
+}
+
+static FileRecord *new_record(FileIndex *idx){
+    if (idx->count == idx->capacity){
+        int capacity = idx->capacity ? idx->capacity * 2 : 256;
+        FileRecord *records = realloc(idx->records, capacity * sizeof(*records));
+        if (records == NULL){
+            return NULL;
+        }
+        idx->records = records;
+        idx->capacity = capacity;
+    }
+    FileRecord *r = &idx->records[idx->count++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+//records every entry of one directory; returns -1 on allocation failure
+static int scan_dir(FileIndex *idx, const Volume *v, unsigned cluster, size_t dir_path){
+    Lfn lfn;
+    lfn.slots = 0;
+    DirIter it;
+    DirEntry *d;
+    dir_open(&it, v, cluster);
+    while ((d = dir_next(&it)) != NULL){
+        if ((d->DIR_Attr & 0x3F) == ATTR_LFN){
+            lfn_add(&lfn, (unsigned char *) d);
+            continue;
+        }
+        if ((d->DIR_Attr & ATTR_VOLUME_ID) || d->DIR_Name[0] == '.'){
+            lfn.slots = 0;
+            continue;
+        }
+
+        FileRecord *r = new_record(idx);
+        if (r == NULL){
+            return -1;
+        }
+        r->entry = dir_offset(&it);
+        r->parent = cluster;
+        r->cluster = dir_entry_cluster(d);
+        r->size = d->DIR_FileSize;
+        r->attr = d->DIR_Attr;
+        r->deleted = d->DIR_Name[0] == DIR_DELETED;
+        dir_entry_name(d, r->short_name);
+
+        //a long name belongs to this entry only if its checksum covers the 8.3 name
+        int have_long = 0;
+        if (lfn.slots && lfn.deleted == r->deleted){
+            unsigned char name[11];
+            memcpy(name, d->DIR_Name, sizeof(name));
+            if (r->deleted){
+                for (const char *c = short_chars; *c != '\0' && !have_long; c++){
+                    name[0] = *c;
+                    have_long = lfn_checksum(name) == lfn.checksum;
+                }
+                r->short_name[0] = name[0];
+            }else{
+                have_long = lfn_checksum(name) == lfn.checksum;
+            }
+        }
+        if (r->deleted && !have_long){
+            r->short_name[0] = '?';
+        }
+        if (have_long){
+            char utf8[LFN_MAX_SLOTS * LFN_SLOT_CHARS * 3 + 1];
+            lfn_utf8(&lfn, utf8);
+            r->long_name = names_push(idx, utf8, strlen(utf8));
+            if (r->long_name == 0){
+                return -1;
+            }
+        }
+        lfn.slots = 0;
+        r->path = names_path(idx, dir_path, r->long_name ? idx->names + r->long_name : r->short_name);
+        if (r->path == 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//a deleted directory keeps only its first cluster; walk it if that still looks like one
+static int deleted_dir_intact(const Volume *v, unsigned cluster){
+    if ((v->fat[cluster] & FAT_MASK) != 0){
+        return 0;
+    }
+    DirEntry *dot = (DirEntry *) volume_cluster(v, cluster);
+    return memcmp(dot->DIR_Name, ".          ", 11) == 0 && (dot->DIR_Attr & ATTR_DIRECTORY);
+}
+
+static uint32_t hash_name(unsigned parent, const char *s){
+    uint32_t h = 2166136261u ^ parent;
+    for (; *s != '\0'; s++){
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_cluster(unsigned cluster){
+    return cluster * 2654435761u;
+}
+
+static int build_tables(FileIndex *idx){
+    unsigned size = 16;
+    while (size < 2 * (unsigned) idx->count) size *= 2;
+    idx->mask = size - 1;
+    idx->by_short = malloc(size * sizeof(int));
+    idx->by_long = malloc(size * sizeof(int));
+    idx->by_cluster = malloc(size * sizeof(int));
+    if (idx->by_short == NULL || idx->by_long == NULL || idx->by_cluster == NULL){
+        return -1;
+    }
+    memset(idx->by_short, -1, size * sizeof(int));
+    memset(idx->by_long, -1, size * sizeof(int));
+    memset(idx->by_cluster, -1, size * sizeof(int));
+
+    //insert back to front so each chain lists entries in walk order
+    for (int i = idx->count - 1; i >= 0; i--){
+        FileRecord *r = &idx->records[i];
+        uint32_t h = hash_name(r->parent, r->short_name + 1) & idx->mask;
+        r->next_short = idx->by_short[h];
+        idx->by_short[h] = i;
+        r->next_long = -1;
+        if (r->long_name){
+            h = hash_name(r->parent, idx->names + r->long_name) & idx->mask;
+            r->next_long = idx->by_long[h];
+            idx->by_long[h] = i;
+        }
+        r->next_cluster = -1;
+        if (r->cluster != 0){
+            h = hash_cluster(r->cluster) & idx->mask;
+            r->next_cluster = idx->by_cluster[h];
+            idx->by_cluster[h] = i;
+        }
+    }
+    return 0;
+}
+
+//walks the whole tree from the root, deleted directories included; returns -1 on allocation failure
+int index_build(FileIndex *idx, const Volume *v){
+    memset(idx, 0, sizeof(*idx));
+    unsigned char *visited = calloc((v->num_clusters + 2 + 7) / 8, 1);
+    int stack_cap = 64, depth = 0;
+    Pending *stack = malloc(stack_cap * sizeof(*stack));
+    //offset 0 is the empty string: the root's path and "no long name"
+    if (visited == NULL || stack == NULL || names_push(idx, "", 0) != 0 || idx->names == NULL){
+        goto fail;
+    }
+
+    unsigned root = v->boot.BPB_RootClus;
+    if (root >= 2 && root < v->num_clusters + 2){
+        visited[root / 8] |= 1 << (root % 8);
+        stack[depth++] = (Pending) {root, 0};
+    }
+    while (depth > 0){
+        Pending dir = stack[--depth];
+        int first = idx->count;
+        if (scan_dir(idx, v, dir.cluster, dir.path) == -1){
+            goto fail;
+        }
+        //push subdirectories last to first, so they come off the stack in directory order
+        for (int i = idx->count - 1; i >= first; i--){
+            FileRecord *r = &idx->records[i];
+            unsigned c = r->cluster;
+            if (!(r->attr & ATTR_DIRECTORY) || c < 2 || c >= v->num_clusters + 2
+                || (visited[c / 8] & (1 << (c % 8))) || (r->deleted && !deleted_dir_intact(v, c))){
+                continue;
+            }
+            visited[c / 8] |= 1 << (c % 8);
+            if (depth == stack_cap){
+                Pending *grown = realloc(stack, 2 * stack_cap * sizeof(*stack));
+                if (grown == NULL){
+                    goto fail;
+                }
+                stack = grown;
+                stack_cap *= 2;
+            }
+            stack[depth++] = (Pending) {c, r->path};
+        }
+    }
+    if (build_tables(idx) == -1){
+        goto fail;
+    }
+    free(visited);
+    free(stack);
+    return 0;
+
+fail:
+    free(visited);
+    free(stack);
+    index_free(idx);
+    return -1;
+}
+
+void index_free(FileIndex *idx){
+    free(idx->records);
+    free(idx->names);
+    free(idx->by_short);
+    free(idx->by_long);
+    free(idx->by_cluster);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static int short_match(const FileRecord *r, unsigned parent, const char *name){
+    return r->deleted && r->parent == parent && strcmp(r->short_name + 1, name + 1) == 0;
+}
+
+static int long_match(const FileIndex *idx, const FileRecord *r, unsigned parent, const char *name){
+    return r->deleted && r->parent == parent && r->long_name && strcmp(idx->names + r->long_name, name) == 0;
+}
+
+//short-name matches first, then long-name matches that the short name did not already give
+FileRecord *index_find_deleted(const FileIndex *idx, unsigned parent, const char *name, const FileRecord *prev){
+    if (name[0] == '\0' || idx->count == 0){
+        return NULL;
+    }
+    int i;
+    if (prev == NULL){
+        i = idx->by_short[hash_name(parent, name + 1) & idx->mask];
+    }else if (short_match(prev, parent, name)){
+        i = prev->next_short;
+    }else{
+        i = -2;
+    }
+    if (i != -2){
+        for (; i != -1; i = idx->records[i].next_short){
+            if (short_match(&idx->records[i], parent, name)){
+                return &idx->records[i];
+            }
+        }
+        i = idx->by_long[hash_name(parent, name) & idx->mask];
+    }else{
+        i = prev->next_long;
+    }
+    for (; i != -1; i = idx->records[i].next_long){
+        FileRecord *r = &idx->records[i];
+        if (long_match(idx, r, parent, name) && !short_match(r, parent, name)){
+            return r;
+        }
+    }
+    return NULL;
+}
+
+FileRecord *index_find_live(const FileIndex *idx, unsigned parent, const char *name){
+    if (name[0] == '\0' || idx->count == 0){
+        return NULL;
+    }
+    for (int i = idx->by_short[hash_name(parent, name + 1) & idx->mask]; i != -1; i = idx->records[i].next_short){
+        FileRecord *r = &idx->records[i];
+        if (!r->deleted && r->parent == parent && strcmp(r->short_name, name) == 0){
+            return r;
+        }
+    }
+    for (int i = idx->by_long[hash_name(parent, name) & idx->mask]; i != -1; i = idx->records[i].next_long){
+        FileRecord *r = &idx->records[i];
+        if (!r->deleted && r->parent == parent && strcmp(idx->names + r->long_name, name) == 0){
+            return r;
+        }
+    }
+    return NULL;
+}
+
+FileRecord *index_by_cluster(const FileIndex *idx, unsigned cluster, const FileRecord *prev){
+    if (idx->count == 0){
+        return NULL;
+    }
+    int i = prev == NULL ? idx->by_cluster[hash_cluster(cluster) & idx->mask] : prev->next_cluster;
+    for (; i != -1; i = idx->records[i].next_cluster){
+        if (idx->records[i].cluster == cluster){
+            return &idx->records[i];
+        }
+    }
+    return NULL;
+}
+
+unsigned index_resolve(const FileIndex *idx, const Volume *v, const char *path, const char **base){
+    unsigned dir = v->boot.BPB_RootClus;
+    const char *slash;
+    while ((slash = strchr(path, '/')) != NULL){
+        size_t len = slash - path;
+        char component[LFN_MAX_SLOTS * LFN_SLOT_CHARS * 3 + 1];
+        if (len >= sizeof(component)){
+            return 0;
+        }
+        memcpy(component, path, len);
+        component[len] = '\0';
+        if (len > 0 && strcmp(component, ".") != 0){
+            FileRecord *r = index_find_live(idx, dir, component);
+            if (r == NULL || !(r->attr & ATTR_DIRECTORY) || r->cluster < 2){
+                return 0;
+            }
+            dir = r->cluster;
+        }
+        path = slash + 1;
+    }
+    *base = path;
+    return dir;
+}
@@ -0,0 +1,55 @@
+#ifndef _FILEINDEX_H_
+#define _FILEINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "volume.h"
+
+//one short directory entry found anywhere in the tree
+typedef struct file_record{
+    uint64_t entry;         //byte offset of the 8.3 DirEntry in the volume
+    unsigned parent;        //first cluster of the containing directory
+    unsigned cluster;       //first cluster of the file
+    unsigned size;
+    unsigned char attr;
+    unsigned char deleted;
+    char short_name[13];    //a deleted entry's lost first letter comes back from its LFN checksum, else '?'
+    size_t path;            //offsets into FileIndex.names; long_name is 0 when there is none
+    size_t long_name;
+    int next_short;         //hash chains, -1 ends
+    int next_long;
+    int next_cluster;
+} FileRecord;
+
+//every live and deleted entry of a volume, reachable by name or by starting cluster
+typedef struct file_index{
+    FileRecord *records;    //in directory walk order (pre-order)
+    int count;
+    int capacity;
+    char *names;            //NUL-separated path and long-name strings
+    size_t names_len;
+    size_t names_cap;
+    int *by_short;          //keyed by (parent, short name past its first letter)
+    int *by_long;           //keyed by (parent, long name)
+    int *by_cluster;
+    unsigned mask;          //table size - 1
+} FileIndex;
+
+int index_build(FileIndex *idx, const Volume *v);
+void index_free(FileIndex *idx);
+
+static inline const char *index_name(const FileIndex *idx, size_t offset){
+    return idx->names + offset;
+}
+
+//deleted entries of `parent` that could have been `name`, one at a time (prev NULL for the first)
+FileRecord *index_find_deleted(const FileIndex *idx, unsigned parent, const char *name, const FileRecord *prev);
+//the live entry of `parent` named `name`, by 8.3 or long name
+FileRecord *index_find_live(const FileIndex *idx, unsigned parent, const char *name);
+//entries starting at `cluster`, one at a time
+FileRecord *index_by_cluster(const FileIndex *idx, unsigned cluster, const FileRecord *prev);
+//cluster of the directory that should hold the last component of "DIR/SUB/NAME", 0 if a
+//directory along the way is missing; *base points at NAME
+unsigned index_resolve(const FileIndex *idx, const Volume *v, const char *path, const char **base);
+
+#endif
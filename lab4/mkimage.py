@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+# Builds the FAT32 test image check.sh runs nyufile on.
+# Usage: python3 mkimage.py out.img
+# Writes out.img and out.img.json, which lists every file put on the image with its
+# clusters and SHA-1. Everything comes from fixed seeds, so the image is the same each run.
+import struct, sys, hashlib, random, json, io, zipfile
+
+out = sys.argv[1]
+BPS = 512
+SPC = 1
+TOT = 8192
+RSVD = 32
+NFATS = 2
+CS = BPS * SPC
+nclus = TOT // SPC
+FATSZ = ((nclus + 2) * 4 + BPS - 1) // BPS
+data_off = (RSVD + NFATS * FATSZ) * BPS
+img = bytearray(TOT * BPS)
+fat = [0] * (nclus + 2)
+fat[0] = 0x0ffffff8
+fat[1] = 0x0fffffff
+EOC = 0x0ffffff8
+
+def caddr(c):
+    return data_off + (c - 2) * CS
+
+# content into the clusters, linked in the FAT unless the file is deleted
+def alloc_chain(clusters, content, link=True):
+    for i, c in enumerate(clusters):
+        piece = content[i * CS:(i + 1) * CS]
+        img[caddr(c):caddr(c) + len(piece)] = piece
+        if link:
+            fat[c] = clusters[i + 1] if i + 1 < len(clusters) else EOC
+
+def name83(n):
+    if n in ('.', '..'):
+        return n.ljust(11).encode()
+    base, _, ext = n.partition('.')
+    return base.ljust(8).encode() + ext.ljust(3).encode()
+
+def lfn_checksum(short):
+    s = 0
+    for b in short:
+        s = (((s & 1) << 7) + (s >> 1) + b) & 0xff
+    return s
+
+def lfn_entries(long, short, deleted):
+    chk = lfn_checksum(short)
+    u = long.encode('utf-16-le') + b'\0\0'
+    while len(u) % 26:
+        u += b'\xff\xff'
+    parts = [u[i:i + 26] for i in range(0, len(u), 26)]
+    ents = []
+    for i, p in enumerate(parts):
+        seq = i + 1
+        if i == len(parts) - 1:
+            seq |= 0x40
+        e = bytes([0xE5 if deleted else seq]) + p[0:10] + bytes([0x0F, 0, chk]) + p[10:22] + b'\0\0' + p[22:26]
+        ents.append(e)
+    return list(reversed(ents))
+
+def dirent(name, attr, cluster, size, deleted=False, long=None):
+    short = name83(name)
+    ents = []
+    if long:
+        ents += lfn_entries(long, short, deleted)
+    if deleted:
+        short = b'\xe5' + short[1:]
+    ents.append(short + struct.pack('<BBBHHHHHHHI', attr, 0, 0, 0, 0, 0, (cluster >> 16) & 0xffff, 0, 0, cluster & 0xffff, size))
+    return ents
+
+def write_dir(clusters, entries):
+    raw = b''.join(entries)
+    need = (len(raw) + 32 + CS - 1) // CS
+    assert need <= len(clusters), (need, len(clusters))
+    alloc_chain(clusters, raw.ljust(len(clusters) * CS, b'\0'))
+
+manifest = []
+def file(name, clusters, size=None, deleted=False, long=None, content=None):
+    r = random.Random(name)
+    if content is not None:
+        size = len(content)
+    if size is None:
+        size = len(clusters) * CS - r.randrange(0, CS // 2)
+    if content is None:
+        content = bytes(r.randrange(256) for _ in range(size))
+    alloc_chain(clusters, content, link=not deleted)
+    manifest.append({'name': name, 'long': long, 'deleted': deleted, 'size': size,
+                     'clusters': clusters, 'sha1': hashlib.sha1(content).hexdigest()})
+    return dirent(name, 0x20, clusters[0] if clusters else 0, size, deleted, long)
+
+# a file with no entry, found only by --carve
+def loose(name, clusters, content):
+    alloc_chain(clusters, content.ljust(len(clusters) * CS, b'\0'), link=False)
+    manifest.append({'name': name, 'clusters': clusters, 'sha1': hashlib.sha1(content).hexdigest()})
+
+root = [2, 30]
+sub = [40]
+subsub = [41]
+root_ents = []
+root_ents += [name83('NYUVOL') + struct.pack('<BBBHHHHHHHI', 0x08, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)]
+root_ents += file('HELLO.TXT', [3], content=b'Hello, world.\n')
+root_ents += file('FILE1.TXT', [4, 5], deleted=True)
+root_ents += file('EMPTY.TXT', [], size=0, content=b'', deleted=True)
+root_ents += file('FRAG.BIN', [6, 11, 9, 14], deleted=True)
+root_ents += file('LIVE.BIN', [7, 8], long='a live long name.bin')
+root_ents += file('FILE2.TXT', [10], deleted=True, long='deleted long file.txt')
+root_ents += file('DUP.TXT', [12], deleted=True)
+root_ents += file('XUP.TXT', [13], deleted=True)
+root_ents += dirent('SUB', 0x10, sub[0], 0)
+root_ents += dirent('GONE', 0x10, 60, 0, deleted=True)
+for i in range(8):
+    root_ents += file('F%d.DAT' % i, [100 + i], content=bytes([65 + i]) * 300)
+root_ents += file('BIG.BIN', list(range(200, 260)), deleted=True)
+root_ents += file('BIGFRAG.BIN', [400, 403, 401, 405, 402, 404, 406], deleted=True)
+root_ents += file('FIVE.BIN', [15, 19, 16, 21, 17], deleted=True)
+zr = random.Random(5)
+zeros = bytes(zr.randrange(256) for _ in range(CS)) + bytes(2 * CS) + bytes(zr.randrange(256) for _ in range(100))
+root_ents += file('ZEROS.BIN', [500, 504, 502, 501], content=zeros, deleted=True)
+# a high word of all ones: 32-bit sums over the start cluster would wrap back into the volume
+root_ents += dirent('WRAP.BIN', 0x20, 0xfffffff0, 16 * CS, deleted=True)
+write_dir(root, root_ents)
+
+sub_ents = dirent('.', 0x10, sub[0], 0) + dirent('..', 0x10, 0, 0)
+sub_ents += file('INNER.TXT', [42], deleted=True, long='inner deleted.txt')
+sub_ents += file('KEEP.TXT', [43])
+sub_ents += dirent('DEEP', 0x10, subsub[0], 0)
+write_dir(sub, sub_ents)
+ss_ents = dirent('.', 0x10, subsub[0], 0) + dirent('..', 0x10, sub[0], 0)
+# starts like a JPEG but has no valid segments, so --carve leaves it
+ss_ents += file('DEEPDEL.JPG', [44, 46], deleted=True, content=b'\xff\xd8\xff\xe0' + bytes(600) + b'\xff\xd9')
+write_dir(subsub, ss_ents)
+
+loose('carve.png', [300, 301], b'\x89PNG\r\n\x1a\n' + bytes(random.Random(1).randrange(256) for _ in range(700)) + b'IEND\xaeB`\x82')
+loose('carve.pdf', [310], b'%PDF-1.4\n' + b'x' * 400 + b'\n%%EOF\n')
+# a JPEG whose EXIF thumbnail ends in an FF D9 of its own, with a stuffed FF 00 and a restart
+# marker in its entropy-coded data
+thumb = b'\xff\xd8\xff\xdb' + struct.pack('>H', 67) + bytes(65) + b'\xff\xd9'
+app1 = b'Exif\0\0' + bytes(range(40)) + thumb
+scan = bytes(random.Random(2).randrange(255) for _ in range(900))
+loose('carve.jpg', [320, 321, 322, 323],
+      b'\xff\xd8\xff\xe1' + struct.pack('>H', len(app1) + 2) + app1 + b'\xff\xdb' + struct.pack('>H', 67) + bytes(65)
+      + b'\xff\xda' + struct.pack('>H', 8) + bytes(6) + scan[:300] + b'\xff\x00' + scan[300:600] + b'\xff\xd0' + scan[600:]
+      + b'\xff\xd9')
+# a ZIP holding a stored ZIP, whose end of central directory record comes first
+def zip_of(members, compression):
+    b = io.BytesIO()
+    with zipfile.ZipFile(b, 'w', compression) as z:
+        for name, data in members:
+            z.writestr(zipfile.ZipInfo(name, (2020, 1, 1, 0, 0, 0)), data)
+    return b.getvalue()
+inner = zip_of([('inner.txt', b'nested\n' * 20)], zipfile.ZIP_STORED)
+outer = zip_of([('inner.zip', inner), ('after.txt', bytes(random.Random(3).randrange(256) for _ in range(700)))], zipfile.ZIP_STORED)
+loose('carve.zip', list(range(600, 600 + (len(outer) + CS - 1) // CS)), outer)
+# a ZIP with a stored JPEG member that starts on a cluster boundary, so it looks like a file
+# of its own: after a 30-byte local header and name, pad.bin ends where the next header does
+photo = b'\xff\xd8\xff\xdb' + struct.pack('>H', 67) + bytes(65) + b'\xff\xda' + struct.pack('>H', 8) + bytes(6) \
+    + bytes(random.Random(4).randrange(255) for _ in range(600)) + b'\xff\xd9'
+pad = bytes(CS - 30 - len('pad.bin') - 30 - len('photo.jpg'))
+album = zip_of([('pad.bin', pad), ('photo.jpg', photo)], zipfile.ZIP_STORED)
+assert album.index(photo) == CS
+loose('album.zip', list(range(620, 620 + (len(album) + CS - 1) // CS)), album)
+
+boot = struct.pack('<3s8sHBHBHHBHHHIIIHHIHH12sBBBI11s8s',
+                   b'\xeb\x58\x90', b'MSWIN4.1', BPS, SPC, RSVD, NFATS, 0, 0, 0xf8, 0, 32, 64, 0,
+                   TOT, FATSZ, 0, 0, 2, 1, 6, b'\0' * 12, 0x80, 0, 0x29, 0x1234, b'NYUVOL     ', b'FAT32   ')
+img[0:len(boot)] = boot
+img[510:512] = b'\x55\xaa'
+fatb = b''.join(struct.pack('<I', x) for x in fat).ljust(FATSZ * BPS, b'\0')
+for i in range(NFATS):
+    o = (RSVD + i * FATSZ) * BPS
+    img[o:o + len(fatb)] = fatb
+open(out, 'wb').write(img)
+json.dump(manifest, open(out + '.json', 'w'), indent=1)
@@ -1,69 +1,84 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <fcntl.h>
-#include <openssl/sha.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <openssl/sha.h>
+#include "volume.h"
+#include "fileindex.h"
+#include "search.h"
+#include "clustermap.h"
+#include "extract.h"
+#include "txn.h"
+#include "digestcache.h"
+#include "carve.h"
 
 #define SHA_DIGEST_LENGTH 20
 
+#define OPT_LIST_DELETED 256   //long-only options
+#define OPT_DEPTH 257
+#define OPT_WINDOW 258
+
+#define OPT_ALL 259
+#define OPT_LIST 260
+#define OPT_JOURNAL 261
+#define OPT_ROLLBACK 262
+#define OPT_CACHE 263
+#define OPT_CARVE 264
+
+#define LOCATE_NONE 0
+#define LOCATE_FOUND 1
+#define LOCATE_MULTIPLE 2
+
+//how far -R looks
+typedef struct recover_options{
+    int num_jobs;
+    unsigned max_clusters;      //longest file to try, counting its first cluster
+    unsigned window;            //clusters to draw the rest of it from
+} RecoverOptions;
+
+//what recovery works from, built once however many files are recovered
+typedef struct recovery{
+    Volume *v;
+    const FileIndex *idx;
+    ClusterMap map;             //free == NULL until a search needs it
+    const RecoverOptions *opts;
+    int out_dir;                //extract into this directory instead of changing the image, or -1
+    int bulk;                   //several files: never hand out a cluster twice
+    Txn txn;                    //in-place changes, written together at the end
+    DigestCache cache;          //what hashing found, possibly from earlier runs
+} Recovery;
+
+#pragma pack(push,1)
+//cache keys: the digest of a contiguous run, which takes no read to look up (the cache file
+//already belongs to this image), and the outcome of a -R search, which includes the
+//fingerprints of the clusters it read since a device written by anything else keeps its mtime
+typedef struct run_key{
+    char kind;                  //'r'
+    uint32_t cluster;
+    uint32_t size;
+} RunKey;
+
+typedef struct search_key{
+    char kind;                  //'s'
+    uint32_t cluster;
+    uint32_t size;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    uint64_t candidates;        //hash of the candidate list, which the free clusters decide
+    uint64_t content;           //hash of the first cluster's and the candidates' fingerprints
+} SearchKey;
+#pragma pack(pop)
+
 /** References:
  * https://www.tutorialspoint.com/c_standard_library/c_function_sprintf.htm
  * Lecture slides
  * Discord chat
 */
 
-#pragma pack(push,1)
-typedef struct BootEntry {
-  unsigned char  BS_jmpBoot[3];     // Assembly instruction to jump to boot code
-  unsigned char  BS_OEMName[8];     // OEM Name in ASCII
-  unsigned short BPB_BytsPerSec;    // Bytes per sector. Allowed values include 512, 1024, 2048, and 4096
-  unsigned char  BPB_SecPerClus;    // Sectors per cluster (data unit). Allowed values are powers of 2, but the cluster size must be 32KB or smaller
-  unsigned short BPB_RsvdSecCnt;    // Size in sectors of the reserved area
-  unsigned char  BPB_NumFATs;       // Number of FATs
-  unsigned short BPB_RootEntCnt;    // Maximum number of files in the root directory for FAT12 and FAT16. This is 0 for FAT32
-  unsigned short BPB_TotSec16;      // 16-bit value of number of sectors in file system
-  unsigned char  BPB_Media;         // Media type
-  unsigned short BPB_FATSz16;       // 16-bit size in sectors of each FAT for FAT12 and FAT16. For FAT32, this field is 0
-  unsigned short BPB_SecPerTrk;     // Sectors per track of storage device
-  unsigned short BPB_NumHeads;      // Number of heads in storage device
-  unsigned int   BPB_HiddSec;       // Number of sectors before the start of partition
-  unsigned int   BPB_TotSec32;      // 32-bit value of number of sectors in file system. Either this value or the 16-bit value above must be 0
-  unsigned int   BPB_FATSz32;       // 32-bit size in sectors of one FAT
-  unsigned short BPB_ExtFlags;      // A flag for FAT
-  unsigned short BPB_FSVer;         // The major and minor version number
-  unsigned int   BPB_RootClus;      // Cluster where the root directory can be found
-  unsigned short BPB_FSInfo;        // Sector where FSINFO structure can be found
-  unsigned short BPB_BkBootSec;     // Sector where backup copy of boot sector is located
-  unsigned char  BPB_Reserved[12];  // Reserved
-  unsigned char  BS_DrvNum;         // BIOS INT13h drive number
-  unsigned char  BS_Reserved1;      // Not used
-  unsigned char  BS_BootSig;        // Extended boot signature to identify if the next three values are valid
-  unsigned int   BS_VolID;          // Volume serial number
-  unsigned char  BS_VolLab[11];     // Volume label in ASCII. User defines when creating the file system
-  unsigned char  BS_FilSysType[8];  // File system type label in ASCII
-} BootEntry;
-#pragma pack(pop)
-
-#pragma pack(push,1)
-typedef struct DirEntry {
-  unsigned char  DIR_Name[11];      // File name
-  unsigned char  DIR_Attr;          // File attributes
-  unsigned char  DIR_NTRes;         // Reserved
-  unsigned char  DIR_CrtTimeTenth;  // Created time (tenths of second)
-  unsigned short DIR_CrtTime;       // Created time (hours, minutes, seconds)
-  unsigned short DIR_CrtDate;       // Created day
-  unsigned short DIR_LstAccDate;    // Accessed day
-  unsigned short DIR_FstClusHI;     // High 2 bytes of the first cluster address
-  unsigned short DIR_WrtTime;       // Written time (hours, minutes, seconds
-  unsigned short DIR_WrtDate;       // Written day
-  unsigned short DIR_FstClusLO;     // Low 2 bytes of the first cluster address
-  unsigned int   DIR_FileSize;      // File size in bytes. (0 for directories)
-} DirEntry;
-#pragma pack(pop)
-
 void print_filename(unsigned char *DIR_Name){
   //printf("%s\n", DIR_Name);
 
@@ -89,51 +104,530 @@ void print_dirname(unsigned char *DIR_Name){
 }
 
 
+//the user's 40 hex digits as a digest, compared with memcmp from then on; -1 if malformed
+static int parse_sha1(const char *hex, unsigned char *md){
+    if (strlen(hex) != SHA_DIGEST_LENGTH*2 || strspn(hex, "0123456789abcdefABCDEF") != SHA_DIGEST_LENGTH*2){
+        return -1;
+    }
+    for (int i = 0; i < SHA_DIGEST_LENGTH; i++){
+        unsigned byte;
+        sscanf(&hex[i*2], "%2x", &byte);
+        md[i] = byte;
+    }
+    return 0;
+}
+
+//whether the clusters a deleted entry claims lie inside the volume, summed in 64 bits so
+//no cluster number in the entry can wrap around
+static int entry_in_volume(const Volume *v, const FileRecord *r){
+    return r->size == 0 || (r->cluster >= 2
+        && (uint64_t) r->cluster + volume_clusters_for(v, r->size) <= (uint64_t) v->num_clusters + 2);
+}
+
+//the letter deletion overwrote: the user's, unless they named the file by its long name
+static char first_letter(const FileRecord *r, const char *base){
+    if (strcmp(r->short_name + 1, base + 1) == 0){
+        return base[0];
+    }
+    return r->short_name[0] != '?' ? r->short_name[0] : '_';
+}
+
+//print every deleted entry in the tree
+static void list_deleted(const FileIndex *idx){
+    int total_entries = 0;
+    for (int i = 0; i < idx->count; i++){
+        const FileRecord *r = &idx->records[i];
+        if (!r->deleted){
+            continue;
+        }
+        printf("%s", index_name(idx, r->path));
+        if (r->attr & ATTR_DIRECTORY){
+            printf("/");
+        }
+        if (r->long_name){
+            printf(" [%s]", r->short_name);
+        }
+        if (r->attr & ATTR_DIRECTORY){
+            printf(" (starting cluster = %u)\n", r->cluster);
+        }else if (r->size == 0){
+            printf(" (size = 0)\n");
+        }else{
+            printf(" (size = %u, starting cluster = %u)\n", r->size, r->cluster);
+        }
+        total_entries++;
+    }
+    printf("Total number of deleted entries = %i\n", total_entries);
+}
+
+//MILESTONE 3 - LIST THE ROOT DIRECTORY
+static void list_root(const Volume *v){
+    int total_entries = 0;
+    DirIter it;
+    DirEntry *d;
+    dir_open(&it, v, v->boot.BPB_RootClus);
+    while ((d = dir_next(&it)) != NULL){
+        if (d->DIR_Name[0] == DIR_DELETED){
+            continue;
+        }
+        unsigned int cluster_num = dir_entry_cluster(d);
+        unsigned int file_size = d->DIR_FileSize;
+        if (d->DIR_Attr == ATTR_DIRECTORY){
+            print_dirname(d->DIR_Name);
+            printf("(starting cluster = %i)\n", cluster_num);
+        }else if (file_size == 0){ //if empty
+            print_filename(d->DIR_Name);
+            printf("(size = %i)\n", file_size);
+        }else{ //if regular file
+            print_filename(d->DIR_Name);
+            printf("(size = %i, ", file_size);
+            printf("starting cluster = %i)\n", cluster_num);
+        }
+        total_entries++;
+    }
+    printf("Total number of entries = %i\n", total_entries);
+}
+
+//a deleted file's clusters, in order
+static unsigned *contiguous_chain(const Volume *v, const FileRecord *r){
+    unsigned cluster_length = volume_clusters_for(v, r->size);
+    unsigned *clusters = malloc((cluster_length + 1) * sizeof(*clusters));
+    if (clusters == NULL){
+        perror("malloc");
+        return NULL;
+    }
+    for (unsigned j = 0; j < cluster_length; j++){
+        clusters[j] = r->cluster + j;
+    }
+    return clusters;
+}
+
+//the free-cluster map, built the first time a search needs it
+static ClusterMap *cluster_map(Recovery *rc){
+    if (rc->map.free == NULL && cluster_map_build(&rc->map, rc->v) == -1){
+        perror("cluster map");
+        return NULL;
+    }
+    return &rc->map;
+}
+
+//SHA-1 of a file of size bytes starting at cluster start, followed by the clusters in rest or,
+//when rest is NULL, by the ones after start; hashed a cluster at a time since the data region
+//is not mapped as one piece
+static void sha1_of_chain(const Volume *v, unsigned start, const unsigned *rest, unsigned size, unsigned char *md){
+    SHA_CTX ctx;
+    VolumeCursor cur;
+    SHA1_Init(&ctx);
+    cursor_open(&cur, v, MADV_SEQUENTIAL);
+    for (unsigned left = size, k = 0; left > 0; k++){
+        unsigned n = left < v->bytes_per_cluster ? left : v->bytes_per_cluster;
+        unsigned c = k == 0 ? start : rest != NULL ? rest[k - 1] : start + k;
+        SHA1_Update(&ctx, cursor_cluster(&cur, c), n);
+        left -= n;
+    }
+    cursor_close(&cur);
+    SHA1_Final(md, &ctx);
+}
+
+//whether the file as if its clusters were contiguous has the given SHA-1. A cached digest
+//that differs rules the run out without reading it; one that matches is hashed again, so
+//what gets restored is checked.
+static int sha1_of_run(Recovery *rc, const FileRecord *r, const unsigned char *sha1){
+    RunKey key = {'r', r->cluster, r->size};
+    uint32_t len;
+    const unsigned char *cached = cache_get(&rc->cache, &key, sizeof(key), &len);
+    if (cached != NULL && len == SHA_DIGEST_LENGTH && memcmp(cached, sha1, SHA_DIGEST_LENGTH) != 0){
+        return 0;
+    }
+    unsigned char md[SHA_DIGEST_LENGTH];
+    sha1_of_chain(rc->v, r->cluster, NULL, r->size, md);
+    cache_put(&rc->cache, &key, sizeof(key), md, sizeof(md)); //a cache miss next time is no harm
+    return memcmp(md, sha1, SHA_DIGEST_LENGTH) == 0;
+}
+
+//Milestone 4-7: the deleted entry a contiguously allocated file came from, picked by SHA-1 if
+//given; *found is left NULL when there is none and when there is more than one without SHA-1
+static int locate_contiguous(Recovery *rc, unsigned dir, const char *base, const unsigned char *sha1, FileRecord **found){
+    *found = NULL;
+    for (FileRecord *r = NULL; dir != 0 && (r = index_find_deleted(rc->idx, dir, base, r)) != NULL; ){
+        if (!entry_in_volume(rc->v, r)){
+            continue;
+        }
+        if (sha1 != NULL){
+            if (!sha1_of_run(rc, r, sha1)){
+                continue;
+            }
+        }else if (*found != NULL){
+            *found = NULL;
+            return LOCATE_MULTIPLE;
+        }
+        *found = r;
+    }
+    return *found != NULL ? LOCATE_FOUND : LOCATE_NONE;
+}
+
+//MILESTONE 8 - the rest of a file sits among the free clusters of a window, in any order.
+//Fills chain with the clusters following start and returns 1 if one ordering matches sha1.
+static int find_chain(Recovery *rc, unsigned start_cluster, unsigned file_size, const unsigned char *sha1, unsigned *chain){
+    const Volume *v = rc->v;
+    const RecoverOptions *opts = rc->opts;
+    ClusterMap *map = cluster_map(rc);
+    if (map == NULL){
+        return 0;
+    }
+    unsigned cluster_length = volume_clusters_for(v, file_size);
+    if (cluster_length > opts->max_clusters){
+        return 0;
+    }
+    //the first `window` clusters when the file starts among them, else the `window` after it
+    unsigned first = start_cluster < 2 + opts->window ? 2 : start_cluster + 1;
+    unsigned last = v->num_clusters + 2 - first > opts->window ? first + opts->window : v->num_clusters + 2;
+    unsigned *candidates = malloc(opts->window * sizeof(*candidates));
+    uint64_t *fingerprints = malloc(opts->window * sizeof(*fingerprints));
+    if (candidates == NULL || fingerprints == NULL){
+        perror("malloc");
+        free(candidates);
+        return 0;
+    }
+    volume_advise(v, first, last - first, MADV_WILLNEED);
+    //a deleted file's clusters are free in the FAT; anything allocated has been reused since.
+    //Zeroed clusters are all alike, so keep only as many as the chain could hold.
+    unsigned num = 0, empty = 0;
+    VolumeCursor cur;
+    cursor_open(&cur, v, MADV_SEQUENTIAL);
+    uint64_t content = cluster_fingerprint(map, &cur, start_cluster);
+    for (unsigned c = first; c < last; c++){
+        if (c == start_cluster || !cluster_free(map, c)){
+            continue;
+        }
+        uint64_t fp = cluster_fingerprint(map, &cur, c);
+        if (fp == FP_EMPTY && empty++ >= cluster_length - 1){
+            continue;
+        }
+        candidates[num] = c;
+        fingerprints[num++] = fp;
+        content = cache_hash(&content, sizeof(content)) ^ fp;
+    }
+    cursor_close(&cur);
+
+    //the same search over the same free clusters holding the same data has the same outcome, so
+    //an earlier run's stands; a chain it found is hashed again all the same before it is used
+    SearchKey key = {'s', start_cluster, file_size, {0}, cache_hash(candidates, num * sizeof(*candidates)), content};
+    memcpy(key.digest, sha1, SHA_DIGEST_LENGTH);
+    uint32_t len, chain_bytes = (cluster_length - 1) * sizeof(*chain);
+    const unsigned char *cached = cache_get(&rc->cache, &key, sizeof(key), &len);
+    int found = -1;
+    if (cached != NULL && len == 1 + chain_bytes){
+        unsigned char md[SHA_DIGEST_LENGTH];
+        found = cached[0];
+        memcpy(chain, cached + 1, chain_bytes);
+        if (found == 1){
+            sha1_of_chain(v, start_cluster, chain, file_size, md);
+            found = memcmp(md, sha1, SHA_DIGEST_LENGTH) == 0 ? 1 : -1;
+        }
+    }
+    if (found == -1){
+        found = search_chain(v, start_cluster, file_size, sha1, candidates, fingerprints, num, opts->num_jobs, chain);
+        if (found == -1){
+            perror("search");
+        }else{
+            unsigned char outcome[1 + chain_bytes];
+            outcome[0] = found;
+            memcpy(outcome + 1, chain, chain_bytes);
+            cache_put(&rc->cache, &key, sizeof(key), outcome, sizeof(outcome));
+        }
+    }
+    free(candidates);
+    free(fingerprints);
+    return found == 1;
+}
+
+//MILESTONE 8 - the deleted entry and cluster chain of a possibly non-contiguous file
+static int locate_fragmented(Recovery *rc, unsigned dir, const char *base, const unsigned char *sha1,
+                             FileRecord **found, unsigned **clusters){
+    for (FileRecord *r = NULL; dir != 0 && (r = index_find_deleted(rc->idx, dir, base, r)) != NULL; ){
+        if (!entry_in_volume(rc->v, r)){
+            continue;
+        }
+        unsigned cluster_length = volume_clusters_for(rc->v, r->size);
+        unsigned *chain = contiguous_chain(rc->v, r);
+        if (chain == NULL){
+            return LOCATE_NONE;
+        }
+        if (cluster_length <= 1 ? sha1_of_run(rc, r, sha1) : find_chain(rc, r->cluster, r->size, sha1, chain + 1)){
+            *found = r;
+            *clusters = chain;
+            return LOCATE_FOUND;
+        }
+        free(chain);
+    }
+    return LOCATE_NONE;
+}
+
+//puts a located file back: in place (name letter and FAT chain), or as a copy under rc->out_dir
+static int restore(Recovery *rc, FileRecord *r, char letter, const unsigned *clusters, const char *label, const char *how){
+    Volume *v = rc->v;
+    unsigned cluster_length = volume_clusters_for(v, r->size);
+    if (rc->out_dir != -1){
+        char written[4096];
+        if (extract_file(v, rc->out_dir, label, clusters, cluster_length, r->size, written, sizeof(written)) == -1){
+            printf("%s: cannot extract: %s\n", label, strerror(errno));
+            return -1;
+        }
+        printf("%s: successfully recovered%s to %s\n", label, how, written);
+        return 0;
+    }
+    //in bulk, an earlier file may already have taken the clusters back
+    for (unsigned k = 0; rc->bulk && k < cluster_length; k++){
+        if ((v->fat[clusters[k]] & FAT_MASK) != 0 || txn_staged(&rc->txn, clusters[k])){
+            printf("%s: clusters already in use\n", label);
+            return -1;
+        }
+    }
+    //Change first letter back to original letter, then link the clusters (in ALL FATs, once
+    //the transaction commits)
+    int ret = txn_set_name(&rc->txn, r->entry, letter);
+    for (unsigned k = 0; ret == 0 && k < cluster_length; k++){
+        ret = txn_set_fat(&rc->txn, clusters[k], k == cluster_length - 1 ? FAT_EOC : clusters[k + 1]);
+    }
+    if (ret == -1){
+        perror("malloc");
+        return -1;
+    }
+    printf("%s: successfully recovered%s\n", label, how);
+    return 0;
+}
+
+//-r (fragmented 0) and -R (fragmented 1) for one file; with a SHA-1 and not fragmented, a
+//file that does not check out as contiguous is searched for as fragmented when try_both is set
+static void recover(Recovery *rc, const char *filename, const unsigned char *sha1, int fragmented, int try_both){
+    const char *base;
+    unsigned dir = index_resolve(rc->idx, rc->v, filename, &base);
+    FileRecord *found = NULL;
+    unsigned *clusters = NULL;
+    int status = LOCATE_NONE;
+    if (!fragmented){
+        status = locate_contiguous(rc, dir, base, sha1, &found);
+        if (status == LOCATE_FOUND){
+            clusters = contiguous_chain(rc->v, found);
+            if (clusters == NULL) return;
+        }
+    }
+    if ((fragmented || (try_both && sha1 != NULL)) && status == LOCATE_NONE){
+        status = locate_fragmented(rc, dir, base, sha1, &found, &clusters);
+    }
+
+    if (status == LOCATE_MULTIPLE){
+        printf("%s: multiple candidates found\n", filename);
+    }else if (status == LOCATE_NONE){
+        printf("%s: file not found\n", filename);
+    }else{
+        restore(rc, found, first_letter(found, base), clusters, filename, sha1 != NULL ? " with SHA-1" : "");
+    }
+    free(clusters);
+}
+
+//--all: every deleted file in the tree, each taken to be contiguous
+static void recover_all(Recovery *rc){
+    const FileIndex *idx = rc->idx;
+    for (int i = 0; i < idx->count; i++){
+        FileRecord *r = &idx->records[i];
+        if (!r->deleted || (r->attr & ATTR_DIRECTORY) || !entry_in_volume(rc->v, r)){
+            continue;
+        }
+        unsigned *clusters = contiguous_chain(rc->v, r);
+        if (clusters == NULL){
+            return;
+        }
+        char letter = r->short_name[0] != '?' ? r->short_name[0] : '_';
+        restore(rc, r, letter, clusters, index_name(idx, r->path), "");
+        free(clusters);
+    }
+}
+
+//--list FILE: one file per line, as sha1sum prints them ("<sha1>  <name>"), or just a name
+static int recover_list(Recovery *rc, const char *list){
+    FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    if (f == NULL){
+        perror(list);
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) != -1){
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        char *name = line;
+        unsigned char digest[SHA_DIGEST_LENGTH], *sha1 = NULL;
+        char sep = len > SHA_DIGEST_LENGTH*2 ? line[SHA_DIGEST_LENGTH*2] : '\0';
+        if (sep == ' ' || sep == '\t'){
+            line[SHA_DIGEST_LENGTH*2] = '\0';
+            if (parse_sha1(line, digest) == 0){
+                sha1 = digest;
+                name = line + SHA_DIGEST_LENGTH*2 + 1;
+                name += strspn(name, " \t");
+                if (*name == '*') name++; //sha1sum's binary-mode marker
+            }else{
+                line[SHA_DIGEST_LENGTH*2] = sep;
+            }
+        }
+        if (*name != '\0'){
+            recover(rc, name, sha1, 0, 1);
+        }
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return 0;
+}
+
+//-o DIR, created if need be
+static int open_out_dir(const char *path){
+    mkdir(path, 0755);
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd == -1){
+        perror(path);
+    }
+    return fd;
+}
+
+//--carve: files whose directory entries are gone, found by their signatures in free space and
+//written to out_dir with a line per file in its carve.map ("name size first-last")
+static int carve_files(const Volume *v, int out_dir, int num_jobs){
+    ClusterMap map;
+    if (cluster_map_build(&map, v) == -1){
+        perror("cluster map");
+        return -1;
+    }
+    Carved *found;
+    unsigned count;
+    if (carve_scan(v, &map, num_jobs, &found, &count) == -1){
+        perror("carve");
+        cluster_map_free(&map);
+        return -1;
+    }
+    int fd = openat(out_dir, "carve.map", O_WRONLY | O_CREAT | O_APPEND, 0644);
+    FILE *log = fd == -1 ? NULL : fdopen(fd, "a");
+    if (log == NULL){
+        perror("carve.map");
+    }
+    int carved = 0;
+    for (unsigned i = 0; i < count; i++){
+        const Carved *c = &found[i];
+        unsigned *clusters = malloc(c->count * sizeof(*clusters));
+        if (clusters == NULL){
+            perror("malloc");
+            break;
+        }
+        for (unsigned k = 0; k < c->count; k++){
+            clusters[k] = c->cluster + k;
+        }
+        char name[32], written[4096];
+        snprintf(name, sizeof(name), "%08u.%s", c->cluster, carve_extension(c->type));
+        if (extract_file(v, out_dir, name, clusters, c->count, c->size, written, sizeof(written)) == -1){
+            printf("%s: cannot extract: %s\n", name, strerror(errno));
+        }else{
+            printf("%s: carved %llu bytes from clusters %u-%u\n", written, (unsigned long long) c->size,
+                   c->cluster, c->cluster + c->count - 1);
+            if (log != NULL){
+                fprintf(log, "%s %llu %u-%u\n", written, (unsigned long long) c->size, c->cluster, c->cluster + c->count - 1);
+            }
+            carved++;
+        }
+        free(clusters);
+    }
+    printf("Total number of carved files = %d\n", carved);
+    if (log != NULL) fclose(log);
+    free(found);
+    cluster_map_free(&map);
+    return 0;
+}
+
 int main(int argc, char* argv[]){
 
     //MILESTONE 1 - VALIDATE USAGE
     int opt;
     char *diskname = NULL;
     char *filename = NULL;
-    char *sha1 = NULL;
-
-    int i_flag = 0, l_flag = 0, r_flag = 0, R_flag = 0, s_flag = 0;
+    unsigned char digest[SHA_DIGEST_LENGTH], *sha1 = NULL;
+    char *cache_file = NULL;
+    char *out_dir = NULL;
+    char *journal = NULL;
+    int status = 0;
+
+    //modes are mutually exclusive; -s goes with -r/-R
+    int mode = 0, s_flag = 0;
+    RecoverOptions opts = {sysconf(_SC_NPROCESSORS_ONLN), 5, 20};
+    static const struct option long_options[] = {
+        {"list-deleted", no_argument, NULL, OPT_LIST_DELETED},
+        {"all", no_argument, NULL, OPT_ALL},
+        {"list", required_argument, NULL, OPT_LIST},
+        {"journal", required_argument, NULL, OPT_JOURNAL},
+        {"rollback", required_argument, NULL, OPT_ROLLBACK},
+        {"cache", required_argument, NULL, OPT_CACHE},
+        {"carve", no_argument, NULL, OPT_CARVE},
+        {"depth", required_argument, NULL, OPT_DEPTH},
+        {"window", required_argument, NULL, OPT_WINDOW},
+        {0, 0, 0, 0}
+    };
 
     if (argc < 3){
       goto usage;
     }
 
-    while ((opt = getopt(argc, argv, "ilr:R:s:")) != -1){
+    while ((opt = getopt_long(argc, argv, "ilr:R:s:j:o:", long_options, NULL)) != -1){
         switch(opt){
-            case 'i': 
-              if (l_flag || r_flag || R_flag){
+            case 'i':
+            case 'l':
+            case OPT_LIST_DELETED:
+            case OPT_ALL:
+            case OPT_CARVE:
+              if (mode){
                 goto usage;
               }
-              i_flag = 1;
-              break; 
-            case 'l': 
-              if (i_flag || r_flag || R_flag){
-                goto usage;
-              }
-              l_flag = 1;
+              mode = opt;
               break;
             case 'r': //need argument, stored in optarg
-              if (i_flag || l_flag || R_flag){
+            case 'R':
+            case OPT_LIST:
+            case OPT_ROLLBACK:
+              if (mode){
                 goto usage;
               }
-              r_flag = 1;
+              mode = opt;
               filename = optarg;
               break;
-            case 'R': 
-              if (i_flag || l_flag || r_flag){
+            case 's':
+              s_flag = 1;
+              if (parse_sha1(optarg, digest) == -1){
                 goto usage;
               }
-              R_flag = 1;
-              filename = optarg;
+              sha1 = digest;
               break;
-            case 's':
-              s_flag = 1;
-              sha1 = optarg;
+            case 'o':
+              out_dir = optarg;
+              break;
+            case OPT_JOURNAL:
+              journal = optarg;
+              break;
+            case OPT_CACHE:
+              cache_file = optarg;
+              break;
+            case 'j':
+              opts.num_jobs = atoi(optarg);
+              if (opts.num_jobs < 1){
+                goto usage;
+              }
+              break;
+            case OPT_DEPTH:
+              if (atoi(optarg) < 1){
+                goto usage;
+              }
+              opts.max_clusters = atoi(optarg);
+              break;
+            case OPT_WINDOW:
+              if (atoi(optarg) < 1){
+                goto usage;
+              }
+              opts.window = atoi(optarg);
               break;
             default:
               goto usage;
@@ -147,522 +641,97 @@ int main(int argc, char* argv[]){
     diskname = argv[optind];
 
     //Make sure -R is followed by a SHA1 always
-    if (R_flag && !s_flag){
+    if (mode == 'R' && !s_flag){
       goto usage;
     }
-
-    //OPEN DISK AND MAP TO MEMORY
-    int fd = open(diskname, O_RDWR);
-    if (fd == -1){
-      perror("File open error\n");
+    //-o only makes sense when recovering, and carving has nowhere else to put files
+    int recovering = mode == 'r' || mode == 'R' || mode == OPT_ALL || mode == OPT_LIST;
+    if ((out_dir != NULL && !recovering && mode != OPT_CARVE) || (mode == OPT_CARVE && out_dir == NULL)){
+      goto usage;
     }
-    struct stat sb;
-    if (fstat(fd, &sb) == -1){
-      perror("fstat error\n");
+    //and a journal only when recovering in place
+    if (journal != NULL && (!recovering || out_dir != NULL)){
+      goto usage;
     }
-    char *addr = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (addr == MAP_FAILED){
-        perror("Mapping error\n");
+
+    //OPEN DISK AND MAP TO MEMORY; only in-place recovery and rollback write to it
+    int writable = (out_dir == NULL && recovering) || mode == OPT_ROLLBACK;
+    Volume vol;
+    if (volume_open(&vol, diskname, writable) == -1){
         exit(EXIT_FAILURE);
     }
-    
-    BootEntry *boot_sector = (BootEntry *) addr; //cast beginning of disk memory to bootsector
+    BootEntry *boot_sector = &vol.boot;
 
     //MILESTONE 2 - PRINT FILE SYSTEM INFO
-    if (i_flag){
+    if (mode == 'i'){
         printf("Number of FATs = %d\n", boot_sector->BPB_NumFATs);
         printf("Number of bytes per sector = %d\n", boot_sector->BPB_BytsPerSec);
         printf("Number of sectors per cluster = %d\n", boot_sector->BPB_SecPerClus);
         printf("Number of reserved sectors = %d\n", boot_sector->BPB_RsvdSecCnt); 
-        exit(EXIT_SUCCESS);
-    }
-
-    //MILESTONE 3 - LIST THE ROOT DIRECTORY
-    //EOF >= 0x 0fff fff8
-    unsigned int root_cluster = boot_sector->BPB_RootClus - 2;
-    unsigned short bytes_per_sector = boot_sector->BPB_BytsPerSec;       
-       
-    //directory entry is addr + (reserved sector + #sectors_per_FAT * #FAT)*size_of_sector + (root_cluster - 2)*(sec_per_cluster * bytes per cluster)   
-       
-    char *dir_entry_addr = ( addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-        + (root_cluster*boot_sector->BPB_SecPerClus))*bytes_per_sector ); //points to beginning of root directory    
-        
-    //dir_entry_addr += 32*1;
-    //DirEntry *dir_entry = (DirEntry *) dir_entry_addr;
-    char* fat_addr = addr + (boot_sector->BPB_RsvdSecCnt * bytes_per_sector); // FAT comes after reserved sector
-    int *fat = (int *) fat_addr;
-
-    if (l_flag){
-          
-        int total_entries = 0;
-        int bytes_searched = 0;
-        int bytes_per_cluster = boot_sector->BPB_SecPerClus * bytes_per_sector;
-        
-        int curr_index = boot_sector->BPB_RootClus;
-
-        while (1){
-          
-          DirEntry *d = (DirEntry *) dir_entry_addr;
-          
-          if (d->DIR_Name[0] == 0x00){
-            break;
-          }else if (d->DIR_Name[0] == 0xE5){
-            //do nothing
-          }else{  
-            //Calculate starting cluster
-            unsigned short lo = d->DIR_FstClusLO; 
-            unsigned short hi = d->DIR_FstClusHI;
-            
-            unsigned int cluster_num = (hi << 8) | lo;
-
-            unsigned int file_size = d->DIR_FileSize; 
-            //if Directory
-            if (d->DIR_Attr == 0x10){
-              print_dirname(d->DIR_Name);
-              printf("(starting cluster = %i)\n", cluster_num);
-            }else if (file_size == 0){ //if empty
-              print_filename(d->DIR_Name);
-              printf("(size = %i)\n", file_size);
-            }else{ //if regular file
-              print_filename(d->DIR_Name);
-              printf("(size = %i, ", file_size);
-              printf("starting cluster = %i)\n", cluster_num);
-            }         
-          total_entries++;
-          }
-          dir_entry_addr += 32;
-          bytes_searched += 32;
-
-          if (bytes_searched == bytes_per_cluster){ //move to next cluster
-              //update pointer to start of next cluster
-              int next_cluster = fat[curr_index];
-              if (next_cluster >= 0xffffff8){
-                break;
-              }
-              else{
-                curr_index = next_cluster;
-                dir_entry_addr = addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-        + ( (curr_index-2) *boot_sector->BPB_SecPerClus))*bytes_per_sector ;
-              }
-              bytes_searched = 0; //reset byte serach
-          }
-
+    }else if (mode == 'l'){
+        list_root(&vol);
+    }else if (mode == OPT_CARVE){
+        int dir = open_out_dir(out_dir);
+        if (dir == -1 || carve_files(&vol, dir, opts.num_jobs) == -1){
+            status = 1;
         }
-        printf("Total number of entries = %i\n", total_entries);
-        exit(EXIT_SUCCESS);
-    }
-    int bytes_per_cluster = boot_sector->BPB_SecPerClus * bytes_per_sector;
-    //Milestone 4-5
-
-    //Milestone 6: count how many filenames could fit the description
-      //print: filename: multiple candidates found
-
-    //Milestone 7: use SHA-1 Hash
-    unsigned char num_fats = boot_sector->BPB_NumFATs;    
-    if (r_flag){
-      int found_candidate = 0;
-      
-      unsigned int file_size;
-      unsigned int update_index;
-      
-      int bytes_searched = 0;
-
-      char* save_entry;
-      int curr_index = boot_sector->BPB_RootClus;
-
-      while (1){
-
-        DirEntry *d = (DirEntry *) dir_entry_addr;
-
-        if (d->DIR_Name[0] == 0x00){
-          break;
-        }else if (d->DIR_Name[0] == 0xE5){
-          char f[13];
-          int i; int j;
-          for (i = 0; i < 8; i++){
-            if (d->DIR_Name[i] == ' '){
-              break;
-            }
-            f[i] = d->DIR_Name[i];
-          }
-
-          if (d->DIR_Name[8] != ' '){
-            f[i++] = '.';
-            for (j = 0; j<3; j++){
-              if (d->DIR_Name[8+j] == ' ') break;
-              f[i++] = d->DIR_Name[8+j];
-            }
-            
-          }
-          f[i] = '\0';
-          char* result = (char*)malloc(strlen(f) + 1);
-          strcpy(result, f);
-          
-          if (strcmp(result + 1, filename + 1) == 0) {//filenames match
-            unsigned short lo = d->DIR_FstClusLO; 
-            unsigned short hi = d->DIR_FstClusHI;
-            //if SHA-1, check the SHAsum
-            if (s_flag){ 
-              //SHA1 computes digest of n bytes at d and places it in md
-              unsigned char md[SHA_DIGEST_LENGTH];
-              
-              //unsigned char user_hash[SHA_DIGEST_LENGTH];
-              //hex2bin(sha1, user_hash, SHA_DIGEST_LENGTH);
-
-              unsigned int cluster = (hi << 8) | lo;
-              //Calculate the address of the start of the file
-              char* file_addr = ( addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-                + ( (cluster - 2)*boot_sector->BPB_SecPerClus) )*bytes_per_sector );
-
-              //compute shasum
-              
-              SHA1((unsigned char*)file_addr, d->DIR_FileSize, md);
-
-              char sha_string[SHA_DIGEST_LENGTH*2 + 1];
-              for (int i = 0; i < SHA_DIGEST_LENGTH; i++){
-                sprintf(&sha_string[i*2], "%02x", md[i]);
-              }
-              //memcmp(md, (unsigned char*)sha1, SHA_DIGEST_LENGTH) != 0
-              if (strcmp(sha_string, sha1) != 0){
-                
-                dir_entry_addr += 32;
-                bytes_searched += 32;
-
-                if (bytes_searched == bytes_per_cluster){ //move to next cluster
-                  //update pointer to start of next cluster
-                  int next_cluster = fat[curr_index];
-                  if (next_cluster >= 0xffffff8){
-                    break;
-                  }else{
-                    curr_index = next_cluster;
-                    dir_entry_addr = addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-                      + ( (curr_index-2) *boot_sector->BPB_SecPerClus))*bytes_per_sector ;
-                  }
-                  bytes_searched = 0; //reset byte serach
-                }
-                continue;
-              }
-
-            }
-
-            if (found_candidate && !s_flag){
-              printf("%s: multiple candidates found\n", filename);
-              exit(EXIT_SUCCESS);
-            }
-            //store cluster number, store file size
-            
-            update_index = (hi << 8) | lo;
-
-            file_size = d->DIR_FileSize;
-            save_entry = dir_entry_addr;
-            found_candidate = 1;
-          }
+        if (dir != -1) close(dir);
+    }else if (mode == OPT_ROLLBACK){
+        if (txn_rollback(&vol, filename) == -1){
+            perror(filename);
+            status = 1;
+        }else{
+            printf("%s: rolled back\n", filename);
         }
-
-        dir_entry_addr += 32;
-        bytes_searched += 32;
-
-        if (bytes_searched == bytes_per_cluster){ //move to next cluster
-          //update pointer to start of next cluster
-          int next_cluster = fat[curr_index];
-          if (next_cluster >= 0xffffff8){
-            break;
-          }else{
-            curr_index = next_cluster;
-            dir_entry_addr = addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-              + ( (curr_index-2) *boot_sector->BPB_SecPerClus))*bytes_per_sector ;
-          }
-          bytes_searched = 0; //reset byte serach
+    }else{
+        //everything else works off the index of the whole tree
+        FileIndex idx;
+        if (index_build(&idx, &vol) == -1){
+            perror("index");
+            volume_close(&vol);
+            exit(EXIT_FAILURE);
         }
-      }
-
-      if (!found_candidate){
-        printf("%s: file not found\n", filename);
-      }else{
-        //Change first letter back to original letter
-        DirEntry *update = (DirEntry *) save_entry;
-        update->DIR_Name[0] = filename[0];
-        //Update ALL FATs
-        int bytes_per_cluster = boot_sector->BPB_SecPerClus * bytes_per_sector;
-        int cluster_length = file_size / bytes_per_cluster ;
-        if (file_size % bytes_per_cluster != 0) {
-          cluster_length++;
-        }
-        for (int i = 0; i < num_fats; i++){
-          char* a = fat_addr + (i* boot_sector->BPB_FATSz32 * bytes_per_sector);
-          int* fat32 = (int*) a;
-
-          for (int j = 0; j < cluster_length; j++){
-            if (j == cluster_length - 1){
-              fat32[update_index + j] = 0x0ffffff8;
-            }else{
-              fat32[update_index + j] = update_index + j + 1;
+        Recovery rc = {&vol, &idx, {0}, &opts, -1, mode == OPT_ALL || mode == OPT_LIST, {0}, {0}};
+        txn_init(&rc.txn, &vol);
+        cache_init(&rc.cache, &vol);
+        if (cache_file != NULL && cache_load(&rc.cache, cache_file) == -1){
+            perror(cache_file);
+        }
+        if (out_dir != NULL){
+            rc.out_dir = open_out_dir(out_dir);
+            if (rc.out_dir == -1){
+                index_free(&idx);
+                volume_close(&vol);
+                exit(EXIT_FAILURE);
             }
-          }
-          
         }
-        
-        if (s_flag){
-          printf("%s: successfully recovered with SHA-1\n", filename);
-        }else{
-          printf("%s: successfully recovered\n", filename);
+        if (mode == OPT_LIST_DELETED){
+            list_deleted(&idx);
+        }else if (mode == 'r' || mode == 'R'){
+            recover(&rc, filename, sha1, mode == 'R', 0);
+        }else if (mode == OPT_ALL){
+            recover_all(&rc);
+        }else if (mode == OPT_LIST){
+            recover_list(&rc, filename);
         }
-        
-      }
-      
-      exit(EXIT_SUCCESS);
-    }
-
-    //MILESTONE 8 - Recover a non-contiguously allocated file
-    //Assumptions:
-      //The entire file is within the first 20 clusters
-      //file content occupies no more than 5 clusters
-
-    if (R_flag){
-      int bytes_searched = 0;
-      int curr_index = boot_sector->BPB_RootClus;
-
-      while (1){
-
-        DirEntry *d = (DirEntry *) dir_entry_addr;
-
-        if (d->DIR_Name[0] == 0x00){
-          break;
+        fflush(stdout);
+        int changed = rc.txn.num_fat != 0 || rc.txn.num_names != 0;
+        if (txn_commit(&rc.txn, journal) == -1){
+            perror(journal != NULL ? journal : "write-back");
+            status = 1;
         }
-        else if (d->DIR_Name[0] == 0xE5){
-          
-          char f[13];
-          int i; int j;
-          for (i = 0; i < 8; i++){
-            if (d->DIR_Name[i] == ' '){
-              break;
-            }
-            f[i] = d->DIR_Name[i];
-          }
-
-          if (d->DIR_Name[8] != ' '){
-            f[i++] = '.';
-            for (j = 0; j<3; j++){
-              if (d->DIR_Name[8+j] == ' ') break;
-              f[i++] = d->DIR_Name[8+j];
-            }
-            
-          }
-          f[i] = '\0';
-          char* result = (char*)malloc(strlen(f) + 1);
-          strcpy(result, f);
-          
-          if (strcmp(result + 1, filename + 1) == 0) {//potential candidate, find permutations and compare checksum
-            unsigned short lo = d->DIR_FstClusLO; 
-            unsigned short hi = d->DIR_FstClusHI;
-
-            unsigned int start_cluster = (hi << 8) | lo;
-            unsigned int file_size = d->DIR_FileSize;
-
-            int bytes_per_cluster = boot_sector->BPB_SecPerClus * bytes_per_sector;
-            //printf("%i\n", start_cluster);
-            int cluster_length = file_size / bytes_per_cluster;
-            if (file_size % bytes_per_cluster != 0) {
-              cluster_length++;
-            }
-
-            char* file_addr = ( addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-                + ( (start_cluster - 2)*boot_sector->BPB_SecPerClus) )*bytes_per_sector );         
-            
-            if (cluster_length <= 1){ //check if file is max one, same as milestone 7
-              unsigned char md[SHA_DIGEST_LENGTH];
-              SHA1((unsigned char*)file_addr, file_size, md);
-
-              char sha_string[SHA_DIGEST_LENGTH*2 + 1];
-              for (int i = 0; i < SHA_DIGEST_LENGTH; i++){
-                sprintf(&sha_string[i*2], "%02x", md[i]);
-              }
-              
-              if (strcmp(sha_string, sha1) != 0){//not match
-                
-                dir_entry_addr += 32;
-                bytes_searched += 32;
-
-                if (bytes_searched == bytes_per_cluster){ //move to next cluster
-                  //update pointer to start of next cluster
-                  int next_cluster = fat[curr_index];
-                  if (next_cluster >= 0xffffff8){
-                    break;
-                  }else{
-                    curr_index = next_cluster;
-                    dir_entry_addr = addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-                      + ( (curr_index-2) *boot_sector->BPB_SecPerClus))*bytes_per_sector ;
-                  }
-                  bytes_searched = 0; //reset byte serach
-                }
-                continue;
-              }else{//found match
-                d->DIR_Name[0] = filename[0]; //restore directory entry
-                
-                //Update ALL FATs
-                if (file_size != 0){
-                  for (int i = 0; i < num_fats; i++){
-                  char* a = fat_addr + (i* boot_sector->BPB_FATSz32 * bytes_per_sector);
-                  int* fat32 = (int*) a;
-
-                  fat32[start_cluster] = 0x0ffffff8;
-                  }
-                }
-                
-                printf("%s: successfully recovered with SHA-1\n",filename);
-                exit(EXIT_SUCCESS);                
-              }
-
-            } //end of cluster length 1
-
-            //COMPUTE PERMUTATIONS
-                //Iterate through all clusters within cluster 20 (18 itr. since start at 2)
-                //make sure to skip if the cluster has already been added to (or equals the start_cluster) permutation -- need to keep track of added cluster alr
-                //update SHA has along the way and check sum
-                //Keep track of indices to update the fats later, EOF last
-                //IF checksum matches:
-                  //save important info, update the directory entry, update all FATS, print success
-            
-            int perm[116280][4]; // array of all permutations
-            
-            unsigned int numbers[] = {2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21};
-            unsigned int total_sectors = boot_sector->BPB_TotSec32;
-            unsigned int data_sectors = total_sectors - (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs)*(boot_sector->BPB_FATSz32));
-            unsigned int data_clusters = (data_sectors / boot_sector->BPB_SecPerClus);
-            int num;
-            if (data_clusters < 20){
-              num = data_clusters ;
-            }else{
-              num = 20;
-            }
-            int perm_cnt = 0;
-            for (int i = 0; i < num; i++){
-
-              if (numbers[i] == start_cluster){
-                  continue;
-              }
-
-              for (int j = 0; j < num; j++){
-
-                if (numbers[j] == start_cluster || j == i){
-                  continue;
-                }
-
-                for (int k = 0; k < num; k++){
-                  if (numbers[k] == start_cluster || k == i || k == j){
-                    continue;
-                  }
-
-                  for (int m = 0; m < num; m++){
-                    if (numbers[m] == start_cluster || m == i || m == j || m == k){
-                      continue;
-                    }
-                    perm[perm_cnt][0] = numbers[i];
-                    perm[perm_cnt][1] = numbers[j];
-                    perm[perm_cnt][2] = numbers[k];
-                    perm[perm_cnt][3] = numbers[m];
-                    perm_cnt++;
-
-                  }
-                }
-              }           
-            }//End of permutations
-
-            //go through permutations and do check sums 
-            //use cluster_length
-            for (int i = 0; i < perm_cnt; i++){
-              SHA_CTX c;
-              SHA1_Init(&c);
-              //add first clsuter to SHA
-              SHA1_Update(&c, file_addr, bytes_per_cluster);
-
-              int j;
-              for (j = 0; j < cluster_length - 1; j++){
-                int clst = perm[i][j];
-                char* chunk_addr = ( addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-                + ( (clst - 2)*boot_sector->BPB_SecPerClus) )*bytes_per_sector );
-
-                if (j == cluster_length - 2){
-                  if (file_size % bytes_per_cluster != 0){
-                    SHA1_Update(&c, chunk_addr, file_size % bytes_per_cluster);
-                  }else{
-                    SHA1_Update(&c, chunk_addr, bytes_per_cluster);
-                  }
-                  //int n = (file_size % bytes_per_cluster != 0) ? (int) (file_size % bytes_per_cluster) : bytes_per_cluster;
-                  //SHA1_Update(&c, chunk_addr, n);
-                }else{
-                  SHA1_Update(&c, chunk_addr, bytes_per_cluster);
-                } 
-
-              }
-
-              //compare hashes
-              //SHA1_Final(unsigned char *md, SHA_CTX *c)
-              unsigned char md[SHA_DIGEST_LENGTH];
-              SHA1_Final(md, &c);
-              char sha_string[SHA_DIGEST_LENGTH*2 + 1];
-              for (int i = 0; i < SHA_DIGEST_LENGTH; i++){
-                sprintf(&sha_string[i*2], "%02x", md[i]);
-              }
-              
-              if (strcmp(sha_string, sha1) == 0){ //hashes match
-                
-                //update Directory entry
-                d->DIR_Name[0] = filename[0];
-                //save permutation
-                int t = i;
-                //UPDATE ALL FATS
-                for (int i = 0; i < num_fats; i++){
-                  char* a = fat_addr + (i* boot_sector->BPB_FATSz32 * bytes_per_sector);
-                  int* fat32 = (int*) a;
-
-                  int fat_ind = start_cluster;
-                  int k;
-                  for (k = 0; k < cluster_length; k++){
-                    if (k == cluster_length - 1){
-                      fat32[fat_ind] = 0x0ffffff8; //EOF
-                    }else{
-                      fat32[fat_ind] = perm[t][k];
-                    }
-                    fat_ind = perm[t][k];
-                  }
- 
-                }
-                //print success and exit
-                printf("%s: successfully recovered with SHA-1\n",filename);
-                exit(EXIT_SUCCESS);  
-              } 
-            } //end of permutation loop
-
-          }
-
-          
-        }
-        //MOVE TO NEXT DIRECTORY ENTRY
-        dir_entry_addr += 32;
-        bytes_searched += 32;
-
-        if (bytes_searched == bytes_per_cluster){ //move to next cluster
-          //update pointer to start of next cluster
-          int next_cluster = fat[curr_index];
-          if (next_cluster >= 0xffffff8){
-            break;
-          }else{
-            curr_index = next_cluster;
-            dir_entry_addr = addr + (boot_sector->BPB_RsvdSecCnt + (boot_sector->BPB_NumFATs * boot_sector->BPB_FATSz32)
-              + ( (curr_index-2) *boot_sector->BPB_SecPerClus))*bytes_per_sector ;
-          }
-          bytes_searched = 0; //reset byte search
-        }
-
-    }//end of while loop
-      
-    //Nothing found
-    printf("%s: file not found\n", filename);
-    exit(EXIT_SUCCESS);
-  }
-
-  return 0;
+        txn_free(&rc.txn);
+        //saved after a commit too: that changes the image but leaves every digest as it was
+        if (cache_file != NULL && (rc.cache.dirty || changed) && cache_save(&rc.cache, cache_file) == -1){
+            perror(cache_file);
+        }
+        cache_free(&rc.cache);
+        if (rc.map.free != NULL) cluster_map_free(&rc.map);
+        if (rc.out_dir != -1) close(rc.out_dir);
+        index_free(&idx);
+    }
+    volume_close(&vol);
+    return status;
    
 //print out usage information
 usage: 
@@ -671,8 +740,21 @@ usage:
   printf("  -l                     List the root directory.\n");
   printf("  -r filename [-s sha1]  Recover a contiguous file.\n");
   printf("  -R filename -s sha1    Recover a possibly non-contiguous file.\n");
+  printf("  -j jobs                Threads for -R and --carve (default: one per CPU).\n");
+  printf("  --depth N              Longest file -R tries, in clusters (default 5).\n");
+  printf("  --window N             -R looks among the first N clusters, or the N after the\n");
+  printf("                         file's first cluster when it starts past them (default 20).\n");
+  printf("  --all                  Recover every deleted file, taking each to be contiguous.\n");
+  printf("  --list file            Recover the files named in file, one per line, each optionally\n");
+  printf("                         preceded by its SHA-1 as sha1sum prints it (- reads stdin).\n");
+  printf("  -o dir                 Copy recovered files into dir and leave the disk untouched.\n");
+  printf("  --journal file         Save what an in-place recovery overwrites to file (new).\n");
+  printf("  --rollback file        Undo the recovery that saved file.\n");
+  printf("  --cache file           Keep SHA-1 results in file for later runs on the same image.\n");
+  printf("  --carve -o dir         Copy out files found by their JPEG, PNG, PDF or ZIP signatures\n");
+  printf("                         in free space, directory entry or not.\n");
+  printf("  --list-deleted         List deleted entries in every directory.\n");
+  printf("A filename may name a subdirectory, as in DIR/FILE.TXT, or be a long name.\n");
   return 1;
 
 }
-
-
@@ -0,0 +1,311 @@
+#define _GNU_SOURCE //qsort_r
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <openssl/sha.h>
+#include "search.h"
+
+#define SPLIT_LEVELS 2          //levels of the tree handed out as work items
+
+//The candidates form a tree: level i picks the (i+1)-th cluster after the first from those
+//not used above it. Walking it depth-first with the SHA-1 state saved at every level hashes
+//each shared prefix once, so a leaf costs one cluster instead of the whole chain.
+//Work items are the arrangements of the top SPLIT_LEVELS levels, numbered in lexicographic
+//order. A match lowers `best` to its item, which stops every worker on a later item. The
+//lowest matching item wins, and inside an item the walk is lexicographic too, so the chain
+//found is the one a serial search would have found.
+//A candidate whose contents equal an earlier one's (its twin) gives the same hashes, so it
+//is only tried at a level where the twin is already used higher up.
+//Every item starts with the first cluster and one candidate, so the states after those two
+//clusters are worked out once, one per candidate, and items start from a copy.
+typedef struct search{
+    const Volume *v;
+    VolumeSpan span;            //the first cluster and every candidate, shared by the workers
+    const unsigned *candidates;
+    int *twin;                  //earlier candidate with the same contents, or -1
+    unsigned n;
+    unsigned m;                 //clusters after the first
+    unsigned split;             //levels per work item
+    unsigned tail;              //bytes of the file in its last cluster
+    const unsigned char *digest;
+    SHA_CTX prefix;             //state after the first cluster, the root of the tree
+    SHA_CTX *second;            //second[i]: prefix extended by candidate i, NULL if that ends the file
+    uint64_t items;
+    atomic_uint_fast64_t next;
+    atomic_uint_fast64_t best;  //items until something matches
+    pthread_mutex_t lock;       //guards chain
+    unsigned *chain;
+} Search;
+
+typedef struct worker{
+    Search *s;
+    uint64_t item;
+    SHA_CTX *ctx;               //ctx[i]: state after the first i + 1 clusters
+    unsigned char *used;
+    unsigned *chain;
+} Worker;
+
+static int digest_matches(const Search *s, SHA_CTX *c){
+    unsigned char md[SHA_DIGEST_LENGTH];
+    SHA1_Final(md, c);
+    return memcmp(md, s->digest, SHA_DIGEST_LENGTH) == 0;
+}
+
+//extends ctx[level] by candidate i into ctx[level + 1]
+static void extend(Worker *w, unsigned level, unsigned i){
+    const Search *s = w->s;
+    w->chain[level] = s->candidates[i];
+    w->ctx[level + 1] = w->ctx[level];
+    SHA1_Update(&w->ctx[level + 1], span_cluster(&s->span, s->candidates[i]),
+                level == s->m - 1 ? s->tail : s->v->bytes_per_cluster);
+}
+
+static void report(Worker *w){
+    Search *s = w->s;
+    pthread_mutex_lock(&s->lock);
+    if (w->item < atomic_load(&s->best)){
+        memcpy(s->chain, w->chain, s->m * sizeof(*s->chain));
+        atomic_store(&s->best, w->item);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+//1 once this item is done with: a match, or an earlier item matched
+static int dfs(Worker *w, unsigned level){
+    Search *s = w->s;
+    for (unsigned i = 0; i < s->n; i++){
+        if (w->used[i] || (s->twin[i] >= 0 && !w->used[s->twin[i]])){
+            continue;
+        }
+        if (atomic_load_explicit(&s->best, memory_order_relaxed) < w->item){
+            return 1;
+        }
+        extend(w, level, i);
+        if (level == s->m - 1){
+            if (digest_matches(s, &w->ctx[level + 1])){
+                report(w);
+                return 1;
+            }
+            continue;
+        }
+        w->used[i] = 1;
+        int done = dfs(w, level + 1);
+        w->used[i] = 0;
+        if (done){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//sets up the item's top levels: digit i picks among the n - i candidates not used yet.
+//Returns 0 for an item that repeats an earlier one through a twin.
+static int start_item(Worker *w){
+    const Search *s = w->s;
+    unsigned digits[SPLIT_LEVELS];
+    uint64_t rank = w->item;
+    for (int i = s->split - 1; i >= 0; i--){
+        digits[i] = rank % (s->n - i);
+        rank /= s->n - i;
+    }
+    memset(w->used, 0, s->n);
+    for (unsigned i = 0; i < s->split; i++){
+        unsigned j = 0;
+        for (unsigned skip = digits[i]; w->used[j] || skip > 0; j++){
+            if (!w->used[j]) skip--;
+        }
+        if (s->twin[j] >= 0 && !w->used[s->twin[j]]){
+            return 0;
+        }
+        w->used[j] = 1;
+        if (i == 0 && s->second != NULL){
+            w->chain[0] = s->candidates[j];
+            w->ctx[1] = s->second[j];
+        }else{
+            extend(w, i, j);
+        }
+    }
+    return 1;
+}
+
+static void *search_worker(void *arg){
+    Worker *w = arg;
+    Search *s = w->s;
+    while ((w->item = atomic_fetch_add(&s->next, 1)) < atomic_load(&s->best)){
+        if (!start_item(w)){
+            continue;
+        }
+        if (s->split == s->m){
+            if (digest_matches(s, &w->ctx[s->m])){
+                report(w);
+            }
+        }else{
+            dfs(w, s->split);
+        }
+    }
+    return NULL;
+}
+
+static int by_fingerprint(const void *a, const void *b, void *keys){
+    const uint64_t *fp = keys;
+    unsigned i = *(const unsigned *) a, j = *(const unsigned *) b;
+    if (fp[i] != fp[j]){
+        return fp[i] < fp[j] ? -1 : 1;
+    }
+    return i < j ? -1 : i > j;
+}
+
+//links each candidate to the previous one with the same fingerprint and contents, so a
+//run of equal clusters is taken in order
+static int find_twins(Search *s, const uint64_t *fingerprints){
+    for (unsigned i = 0; i < s->n; i++){
+        s->twin[i] = -1;
+    }
+    if (fingerprints == NULL){
+        return 0;
+    }
+    unsigned *order = malloc(s->n * sizeof(*order));
+    if (order == NULL){
+        return -1;
+    }
+    for (unsigned i = 0; i < s->n; i++){
+        order[i] = i;
+    }
+    qsort_r(order, s->n, sizeof(*order), by_fingerprint, (void *) fingerprints);
+    for (unsigned i = 1, first = 0, last = 0; i < s->n; i++){
+        if (fingerprints[order[i]] != fingerprints[order[first]]){
+            first = last = i;
+        }else if (memcmp(span_cluster(&s->span, s->candidates[order[i]]),
+                         span_cluster(&s->span, s->candidates[order[first]]), s->v->bytes_per_cluster) == 0){
+            s->twin[order[i]] = order[last];
+            last = i;
+        }
+    }
+    free(order);
+    return 0;
+}
+
+static int worker_init(Worker *w, Search *s){
+    w->s = s;
+    w->ctx = malloc((s->m + 1) * sizeof(*w->ctx));
+    w->used = malloc(s->n);
+    w->chain = malloc(s->m * sizeof(*w->chain));
+    if (w->ctx == NULL || w->used == NULL || w->chain == NULL){
+        return -1;
+    }
+    w->ctx[0] = s->prefix;
+    return 0;
+}
+
+static void worker_free(Worker *w){
+    free(w->ctx);
+    free(w->used);
+    free(w->chain);
+}
+
+//the table behind Search.second; left NULL when the file is two clusters, since then the
+//candidate is hashed only up to the file's end
+static int hash_second(Search *s){
+    s->second = NULL;
+    if (s->m < 2){
+        return 0;
+    }
+    s->second = malloc(s->n * sizeof(*s->second));
+    if (s->second == NULL){
+        return -1;
+    }
+    for (unsigned i = 0; i < s->n; i++){
+        s->second[i] = s->prefix;
+        SHA1_Update(&s->second[i], span_cluster(&s->span, s->candidates[i]), s->v->bytes_per_cluster);
+    }
+    return 0;
+}
+
+int search_chain(const Volume *v, unsigned start, unsigned size, const unsigned char *digest,
+                 const unsigned *candidates, const uint64_t *fingerprints, unsigned num_candidates,
+                 int num_jobs, unsigned *chain){
+    Search s;
+    s.v = v;
+    s.candidates = candidates;
+    s.n = num_candidates;
+    s.m = volume_clusters_for(v, size) - 1;
+    s.tail = size - ((size_t) s.m << v->cluster_shift);
+    s.digest = digest;
+    s.chain = chain;
+    if (s.m == 0 || s.m > s.n){
+        return 0;
+    }
+    s.split = s.m < SPLIT_LEVELS ? s.m : SPLIT_LEVELS;
+    s.items = 1;
+    for (unsigned i = 0; i < s.split; i++){
+        s.items *= s.n - i;
+    }
+    //every read of the search falls in one span, mapped once: private cursors would remap
+    //their windows over and over once the candidates spread past a few of them
+    unsigned lo = start, hi = start;
+    for (unsigned i = 0; i < s.n; i++){
+        lo = candidates[i] < lo ? candidates[i] : lo;
+        hi = candidates[i] > hi ? candidates[i] : hi;
+    }
+    if (span_open(&s.span, v, lo, hi - lo + 1, MADV_NORMAL) == -1){
+        return -1;
+    }
+    s.twin = malloc(s.n * sizeof(*s.twin));
+    int ready = s.twin != NULL && find_twins(&s, fingerprints) == 0;
+    if (ready){
+        SHA1_Init(&s.prefix);
+        SHA1_Update(&s.prefix, span_cluster(&s.span, start), v->bytes_per_cluster);
+        ready = hash_second(&s) == 0;
+    }
+    if (!ready){
+        free(s.twin);
+        span_close(&s.span);
+        return -1;
+    }
+    atomic_init(&s.next, 0);
+    atomic_init(&s.best, s.items);
+    pthread_mutex_init(&s.lock, NULL);
+
+    if ((uint64_t) num_jobs > s.items){
+        num_jobs = s.items;
+    }
+    Worker *workers = calloc(num_jobs, sizeof(*workers));
+    pthread_t *threads = malloc(num_jobs * sizeof(*threads));
+    ready = workers != NULL && threads != NULL;
+    for (int i = 0; ready && i < num_jobs; i++){
+        ready = worker_init(&workers[i], &s) == 0;
+    }
+    if (!ready){
+        for (int i = 0; workers != NULL && i < num_jobs; i++) worker_free(&workers[i]);
+        free(workers);
+        free(threads);
+        free(s.twin);
+        free(s.second);
+        span_close(&s.span);
+        pthread_mutex_destroy(&s.lock);
+        return -1;
+    }
+
+    int started = 1;
+    for (; started < num_jobs; started++){
+        if (pthread_create(&threads[started], NULL, search_worker, &workers[started]) != 0){
+            break;
+        }
+    }
+    search_worker(&workers[0]); //the caller is a worker too
+    for (int i = 1; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < num_jobs; i++) worker_free(&workers[i]);
+    free(workers);
+    free(threads);
+    free(s.twin);
+    free(s.second);
+    span_close(&s.span);
+    pthread_mutex_destroy(&s.lock);
+    return atomic_load(&s.best) < s.items;
+}
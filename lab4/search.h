@@ -0,0 +1,15 @@
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include "volume.h"
+
+//Finds the order of the clusters that follow `start` in a deleted file of `size` bytes whose
+//SHA-1 is `digest` (binary), trying every arrangement of candidates across num_jobs threads.
+//Candidates with equal fingerprints (NULL: none given) and equal contents are tried only once
+//per position. Returns 1 and fills chain with the clusters after start (clusters_for(size) - 1
+//of them), 0 if nothing matches, -1 if memory runs out.
+int search_chain(const Volume *v, unsigned start, unsigned size, const unsigned char *digest,
+                 const unsigned *candidates, const uint64_t *fingerprints, unsigned num_candidates,
+                 int num_jobs, unsigned *chain);
+
+#endif
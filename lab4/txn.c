@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "txn.h"
+
+#define RUN_GAP 128             //FAT writes this close (one sector of entries) share a range
+#define JOURNAL_MAGIC "NYUJRNL1"
+
+//journal layout: header, then per range {offset, len, old bytes}, then a checksum of it all
+typedef struct journal_header{
+    char magic[8];
+    uint32_t volume_id;
+    uint32_t num_records;
+    uint64_t volume_size;
+} JournalHeader;
+
+void txn_init(Txn *t, Volume *v){
+    memset(t, 0, sizeof(*t));
+    t->v = v;
+}
+
+void txn_free(Txn *t){
+    free(t->fat);
+    free(t->names);
+    free(t->staged);
+    txn_init(t, t->v);
+}
+
+static int grow(void **array, unsigned *cap, unsigned count, size_t size){
+    if (count < *cap){
+        return 0;
+    }
+    unsigned new_cap = *cap ? *cap * 2 : 64;
+    void *p = realloc(*array, new_cap * size);
+    if (p == NULL){
+        return -1;
+    }
+    *array = p;
+    *cap = new_cap;
+    return 0;
+}
+
+int txn_set_fat(Txn *t, unsigned cluster, uint32_t value){
+    if (t->staged == NULL){
+        t->staged = calloc((t->v->num_clusters + 2 + 63) / 64, sizeof(*t->staged));
+        if (t->staged == NULL){
+            return -1;
+        }
+    }
+    //a second write to a cluster replaces the first
+    if (txn_staged(t, cluster)){
+        for (unsigned i = 0; i < t->num_fat; i++){
+            if (t->fat[i].cluster == cluster){
+                t->fat[i].value = value;
+                return 0;
+            }
+        }
+    }
+    if (grow((void **) &t->fat, &t->fat_cap, t->num_fat, sizeof(*t->fat)) == -1){
+        return -1;
+    }
+    t->fat[t->num_fat++] = (FatWrite) {cluster, value};
+    t->staged[cluster / 64] |= (uint64_t) 1 << (cluster % 64);
+    return 0;
+}
+
+int txn_set_name(Txn *t, uint64_t entry, unsigned char letter){
+    if (grow((void **) &t->names, &t->names_cap, t->num_names, sizeof(*t->names)) == -1){
+        return -1;
+    }
+    t->names[t->num_names++] = (NameWrite) {entry, letter};
+    return 0;
+}
+
+static int by_cluster(const void *a, const void *b){
+    unsigned x = ((const FatWrite *) a)->cluster, y = ((const FatWrite *) b)->cluster;
+    return (x > y) - (x < y);
+}
+
+static int by_entry(const void *a, const void *b){
+    uint64_t x = ((const NameWrite *) a)->entry, y = ((const NameWrite *) b)->entry;
+    return (x > y) - (x < y);
+}
+
+//the mapped byte at a volume offset in the FATs or the data region
+static char *volume_at(const Volume *v, uint64_t offset){
+    if (offset < v->data_offset){
+        return (char *) v->fat + (offset - v->fat_offset);
+    }
+    return volume_data(v, offset - v->data_offset);
+}
+
+static uint64_t fat_copy_offset(const Volume *v, unsigned copy, unsigned cluster){
+    return v->fat_offset + copy * v->fat_bytes + (uint64_t) cluster * sizeof(uint32_t);
+}
+
+//waits for [p, p + len) of a shared mapping to be written back
+static int sync_range(char *p, size_t len){
+    char *page = (char *) ((uintptr_t) p & ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1));
+    return msync(page, p + len - page, MS_SYNC);
+}
+
+static uint64_t fnv1a(const char *p, size_t len){
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++){
+        h = (h ^ (unsigned char) p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+//ranges of t->fat (sorted) that go out together: fat[i .. end) with end returned
+static unsigned run_end(const Txn *t, unsigned i){
+    unsigned end = i + 1;
+    while (end < t->num_fat && t->fat[end].cluster - t->fat[end - 1].cluster <= RUN_GAP) end++;
+    return end;
+}
+
+static void journal_put(char **p, uint64_t offset, uint32_t len, const char *old){
+    memcpy(*p, &offset, sizeof(offset));
+    memcpy(*p + sizeof(offset), &len, sizeof(len));
+    memcpy(*p + sizeof(offset) + sizeof(len), old, len);
+    *p += sizeof(offset) + sizeof(len) + len;
+}
+
+//saves the bytes the commit will overwrite; the journal is on disk before anything changes
+static int journal_write(const Txn *t, const char *path){
+    const Volume *v = t->v;
+    size_t record = sizeof(uint64_t) + sizeof(uint32_t);
+    size_t len = sizeof(JournalHeader) + sizeof(uint64_t);
+    uint32_t num_records = 0;
+    for (unsigned i = 0; i < t->num_fat; i = run_end(t, i)){
+        unsigned n = t->fat[run_end(t, i) - 1].cluster - t->fat[i].cluster + 1;
+        len += v->num_fats * (record + n * sizeof(uint32_t));
+        num_records += v->num_fats;
+    }
+    len += t->num_names * (record + 1);
+    num_records += t->num_names;
+
+    char *buf = malloc(len), *p = buf;
+    if (buf == NULL){
+        return -1;
+    }
+    JournalHeader h = {JOURNAL_MAGIC, v->boot.BS_VolID, num_records, v->size};
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    for (unsigned i = 0; i < t->num_fat; i = run_end(t, i)){
+        unsigned lo = t->fat[i].cluster, n = t->fat[run_end(t, i) - 1].cluster - lo + 1;
+        for (unsigned k = 0; k < v->num_fats; k++){
+            uint64_t offset = fat_copy_offset(v, k, lo);
+            journal_put(&p, offset, n * sizeof(uint32_t), volume_at(v, offset));
+        }
+    }
+    for (unsigned i = 0; i < t->num_names; i++){
+        journal_put(&p, t->names[i].entry, 1, volume_at(v, t->names[i].entry));
+    }
+    uint64_t sum = fnv1a(buf, p - buf);
+    memcpy(p, &sum, sizeof(sum));
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd == -1){
+        free(buf);
+        return -1;
+    }
+    for (p = buf; len > 0; ){
+        ssize_t n = write(fd, p, len);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        len -= n;
+    }
+    int ret = len == 0 && fsync(fd) == 0 ? 0 : -1;
+    int saved = errno;
+    free(buf);
+    close(fd);
+    if (ret == -1){
+        unlink(path);
+        errno = saved;
+    }
+    return ret;
+}
+
+int txn_commit(Txn *t, const char *journal){
+    Volume *v = t->v;
+    if (t->num_fat == 0 && t->num_names == 0){
+        return 0;
+    }
+    if (t->num_fat > 0) qsort(t->fat, t->num_fat, sizeof(*t->fat), by_cluster);
+    if (t->num_names > 0) qsort(t->names, t->num_names, sizeof(*t->names), by_entry);
+    if (journal != NULL && journal_write(t, journal) == -1){
+        return -1;
+    }
+
+    //FATs before names: a crash in between leaves clusters allocated to nothing, which fsck
+    //reclaims, rather than a live entry whose clusters are free for the taking
+    for (unsigned i = 0; i < t->num_fat; ){
+        unsigned end = run_end(t, i), lo = t->fat[i].cluster, hi = t->fat[end - 1].cluster;
+        for (unsigned k = 0; k < v->num_fats; k++){
+            uint32_t *fat = (uint32_t *) volume_at(v, fat_copy_offset(v, k, 0));
+            for (unsigned j = i; j < end; j++){
+                uint32_t *e = &fat[t->fat[j].cluster];
+                *e = (*e & ~FAT_MASK) | (t->fat[j].value & FAT_MASK);
+            }
+            if (sync_range((char *) &fat[lo], (hi - lo + 1) * sizeof(uint32_t)) == -1){
+                return -1;
+            }
+        }
+        i = end;
+    }
+    for (unsigned i = 0; i < t->num_names; ){
+        char *page = NULL;
+        unsigned end = i;
+        //entries on the same page are synced together
+        for (; end < t->num_names; end++){
+            DirEntry *d = volume_entry(v, t->names[end].entry);
+            char *p = (char *) ((uintptr_t) d & ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1));
+            if (page != NULL && p != page){
+                break;
+            }
+            page = p;
+            d->DIR_Name[0] = t->names[end].letter;
+        }
+        DirEntry *last = volume_entry(v, t->names[end - 1].entry);
+        if (sync_range(page, (char *) last + 1 - page) == -1){
+            return -1;
+        }
+        i = end;
+    }
+    txn_free(t);
+    return 0;
+}
+
+static int read_all(const char *path, char **out, size_t *len){
+    int fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd == -1){
+        return -1;
+    }
+    if (fstat(fd, &sb) == -1 || (*out = malloc(sb.st_size + 1)) == NULL){
+        close(fd);
+        return -1;
+    }
+    size_t got = 0;
+    while (got < (size_t) sb.st_size){
+        ssize_t n = read(fd, *out + got, sb.st_size - got);
+        if (n <= 0){
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        got += n;
+    }
+    close(fd);
+    *len = got;
+    return 0;
+}
+
+//whether [offset, offset + len) lies in one FAT copy, or in one chunk of the data region
+static int journal_range_ok(const Volume *v, uint64_t offset, uint32_t len){
+    if (offset >= v->fat_offset && offset < v->data_offset){
+        uint64_t copy_end = v->fat_offset + ((offset - v->fat_offset) / v->fat_bytes + 1) * v->fat_bytes;
+        return len <= copy_end - offset;
+    }
+    uint64_t data_len = volume_cluster_offset(v, v->num_clusters + 2);
+    if (offset < v->data_offset || offset - v->data_offset >= data_len || len > data_len - (offset - v->data_offset)){
+        return 0;
+    }
+    uint64_t rel = offset - v->data_offset;
+    return len <= CHUNK_SIZE - (rel & (CHUNK_SIZE - 1));
+}
+
+int txn_rollback(Volume *v, const char *journal){
+    char *buf;
+    size_t len;
+    if (read_all(journal, &buf, &len) == -1){
+        return -1;
+    }
+    //check every record before changing anything
+    JournalHeader h;
+    uint64_t sum;
+    int ok = len >= sizeof(h) + sizeof(sum);
+    if (ok){
+        memcpy(&h, buf, sizeof(h));
+        memcpy(&sum, buf + len - sizeof(sum), sizeof(sum));
+        ok = memcmp(h.magic, JOURNAL_MAGIC, sizeof(h.magic)) == 0 && sum == fnv1a(buf, len - sizeof(sum))
+            && h.volume_id == v->boot.BS_VolID && h.volume_size == v->size;
+    }
+    const char *end = buf + len - sizeof(sum), *p = buf + sizeof(h);
+    for (uint32_t i = 0; ok && i < h.num_records; i++){
+        uint64_t offset;
+        uint32_t n;
+        ok = end - p >= (ptrdiff_t) (sizeof(offset) + sizeof(n));
+        if (ok){
+            memcpy(&offset, p, sizeof(offset));
+            memcpy(&n, p + sizeof(offset), sizeof(n));
+            p += sizeof(offset) + sizeof(n);
+            ok = (uint64_t) (end - p) >= n && journal_range_ok(v, offset, n);
+            p += ok ? n : 0;
+        }
+    }
+    if (!ok || p != end){
+        free(buf);
+        errno = EINVAL;
+        return -1;
+    }
+
+    //undo in the opposite order to txn_commit: directory entries, then the FATs
+    for (int pass = 0; pass < 2; pass++){
+        p = buf + sizeof(h);
+        for (uint32_t i = 0; i < h.num_records; i++){
+            uint64_t offset;
+            uint32_t n;
+            memcpy(&offset, p, sizeof(offset));
+            memcpy(&n, p + sizeof(offset), sizeof(n));
+            p += sizeof(offset) + sizeof(n);
+            if ((offset >= v->data_offset) == (pass == 0)){
+                char *dst = volume_at(v, offset);
+                memcpy(dst, p, n);
+                if (sync_range(dst, n) == -1){
+                    free(buf);
+                    return -1;
+                }
+            }
+            p += n;
+        }
+    }
+    free(buf);
+    return unlink(journal);
+}
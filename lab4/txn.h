@@ -0,0 +1,46 @@
+#ifndef _TXN_H_
+#define _TXN_H_
+
+#include <stdint.h>
+#include "volume.h"
+
+typedef struct fat_write{
+    unsigned cluster;
+    uint32_t value;
+} FatWrite;
+
+typedef struct name_write{
+    uint64_t entry;             //volume offset of the DirEntry
+    unsigned char letter;       //new DIR_Name[0]
+} NameWrite;
+
+//changes to a volume, held back until txn_commit writes them all at once
+typedef struct txn{
+    Volume *v;
+    FatWrite *fat;
+    unsigned num_fat;
+    unsigned fat_cap;
+    NameWrite *names;
+    unsigned num_names;
+    unsigned names_cap;
+    uint64_t *staged;           //bitmap of clusters with a FAT write pending
+} Txn;
+
+void txn_init(Txn *t, Volume *v);
+void txn_free(Txn *t);
+//returns -1 on allocation failure
+int txn_set_fat(Txn *t, unsigned cluster, uint32_t value);
+int txn_set_name(Txn *t, uint64_t entry, unsigned char letter);
+
+static inline int txn_staged(const Txn *t, unsigned cluster){
+    return t->staged != NULL && (t->staged[cluster / 64] >> (cluster % 64) & 1);
+}
+
+//Writes everything staged, FATs first and directory entries after, each FAT range into every
+//copy, and waits for each range to reach the disk. With a journal path, what the writes
+//replace is saved there (and synced) first, so txn_rollback can undo them. Returns -1 on error.
+int txn_commit(Txn *t, const char *journal);
+//puts back what a journal saved and removes it; returns -1 if it is damaged or for another volume
+int txn_rollback(Volume *v, const char *journal);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "volume.h"
+
+//bytes in an image file, or in the device for a block device (whose st_size is 0)
+static int volume_size(int fd, uint64_t *size){
+    struct stat sb;
+    if (fstat(fd, &sb) == -1){
+        return -1;
+    }
+    if (S_ISBLK(sb.st_mode)){
+        return ioctl(fd, BLKGETSIZE64, size);
+    }
+    *size = sb.st_size;
+    return 0;
+}
+
+static uint64_t page_floor(uint64_t offset){
+    return offset & ~(uint64_t) (sysconf(_SC_PAGESIZE) - 1);
+}
+
+//reads the boot sector and works out the geometry; only the FATs are mapped here, the data
+//region comes in as it is used. Returns -1 on error.
+//A read-only volume is mapped without write access, so nothing can change the image.
+int volume_open(Volume *v, const char *path, int writable){
+    memset(v, 0, sizeof(*v));
+    v->writable = writable;
+    v->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (v->fd == -1){
+        perror("File open error");
+        return -1;
+    }
+    if (volume_size(v->fd, &v->size) == -1){
+        perror("fstat error");
+        close(v->fd);
+        return -1;
+    }
+    if (v->size < sizeof(BootEntry) || pread(v->fd, &v->boot, sizeof(BootEntry), 0) != sizeof(BootEntry)){
+        fprintf(stderr, "%s: not a FAT32 volume\n", path);
+        close(v->fd);
+        return -1;
+    }
+
+    BootEntry *b = &v->boot;
+    v->bytes_per_sector = b->BPB_BytsPerSec;
+    v->bytes_per_cluster = b->BPB_SecPerClus * v->bytes_per_sector;
+    v->num_fats = b->BPB_NumFATs;
+    v->fat_offset = (uint64_t) b->BPB_RsvdSecCnt * v->bytes_per_sector;
+    v->fat_bytes = (uint64_t) b->BPB_FATSz32 * v->bytes_per_sector;
+    v->data_offset = v->fat_offset + v->num_fats * v->fat_bytes;
+
+    //cluster sizes are powers of two, so addresses are a shift away; the spec stops at 32 KiB,
+    //far below a cursor window
+    unsigned bpc = v->bytes_per_cluster;
+    if (bpc == 0 || (bpc & (bpc - 1)) != 0 || bpc > WINDOW_SIZE || v->num_fats == 0 || v->data_offset >= v->size){
+        fprintf(stderr, "%s: not a FAT32 volume\n", path);
+        close(v->fd);
+        return -1;
+    }
+    while ((1u << v->cluster_shift) < bpc) v->cluster_shift++;
+
+    //trust the smallest of what the boot sector, the FAT and the image allow
+    uint64_t clusters = (v->size - v->data_offset) >> v->cluster_shift;
+    uint64_t sectors = b->BPB_TotSec32 ? b->BPB_TotSec32 : b->BPB_TotSec16;
+    uint64_t data_sectors = sectors * v->bytes_per_sector > v->data_offset
+        ? sectors - v->data_offset / v->bytes_per_sector : 0;
+    if (data_sectors / b->BPB_SecPerClus < clusters) clusters = data_sectors / b->BPB_SecPerClus;
+    if (v->fat_bytes / 4 < clusters + 2) clusters = v->fat_bytes / 4 >= 2 ? v->fat_bytes / 4 - 2 : 0;
+    v->num_clusters = clusters;
+
+    //the FATs are read end to end by every mode that walks the tree
+    uint64_t fat_start = page_floor(v->fat_offset);
+    v->fat_map_len = v->data_offset - fat_start;
+    v->fat_map = mmap(NULL, v->fat_map_len, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, v->fd, fat_start);
+    if (v->fat_map == MAP_FAILED){
+        v->fat_map = NULL;
+        perror("Mapping error");
+        close(v->fd);
+        return -1;
+    }
+    madvise(v->fat_map, v->fat_map_len, MADV_WILLNEED);
+    v->fat = (uint32_t *) (v->fat_map + (v->fat_offset - fat_start));
+
+    uint64_t data_bytes = volume_cluster_offset(v, v->num_clusters + 2);
+    v->num_chunks = (data_bytes + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    v->chunks = calloc(v->num_chunks + 1, sizeof(*v->chunks));
+    if (v->chunks == NULL){
+        perror("calloc");
+        volume_close(v);
+        return -1;
+    }
+    return 0;
+}
+
+//the mapping of chunk i starts at the page holding its first byte
+static void chunk_extent(const Volume *v, unsigned i, uint64_t *start, size_t *len, size_t *skip){
+    uint64_t begin = v->data_offset + ((uint64_t) i << CHUNK_SHIFT);
+    uint64_t end = begin + CHUNK_SIZE < v->size ? begin + CHUNK_SIZE : v->size;
+    *start = page_floor(begin);
+    *len = end - *start;
+    *skip = begin - *start;
+}
+
+//maps chunk i on first use; threads racing to map the same chunk keep whichever came first
+char *volume_map_chunk(const Volume *v, unsigned i){
+    uint64_t start;
+    size_t len, skip;
+    chunk_extent(v, i, &start, &len, &skip);
+    char *addr = mmap(NULL, len, v->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, v->fd, start);
+    if (addr == MAP_FAILED){
+        perror("Mapping error");
+        exit(EXIT_FAILURE);
+    }
+    char *chunk = addr + skip, *expected = NULL;
+    if (!atomic_compare_exchange_strong(&v->chunks[i], &expected, chunk)){
+        munmap(addr, len);
+        return expected;
+    }
+    return chunk;
+}
+
+static int file_advice(int advice){
+    switch (advice){
+        case MADV_WILLNEED: return POSIX_FADV_WILLNEED;
+        case MADV_SEQUENTIAL: return POSIX_FADV_SEQUENTIAL;
+        case MADV_RANDOM: return POSIX_FADV_RANDOM;
+        default: return POSIX_FADV_NORMAL;
+    }
+}
+
+//never maps anything itself: a hint is no reason to take up address space
+void volume_advise(const Volume *v, unsigned cluster, unsigned count, int advice){
+    uint64_t offset = volume_cluster_offset(v, cluster);
+    uint64_t end = offset + ((uint64_t) count << v->cluster_shift);
+    while (offset < end){
+        uint64_t chunk_end = (offset | (CHUNK_SIZE - 1)) + 1;
+        uint64_t stop = end < chunk_end ? end : chunk_end;
+        char *chunk = atomic_load_explicit(&v->chunks[offset >> CHUNK_SHIFT], memory_order_acquire);
+        if (chunk != NULL){
+            char *p = chunk + (offset & (CHUNK_SIZE - 1));
+            char *page = (char *) ((uintptr_t) p & ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1));
+            madvise(page, p - page + (stop - offset), advice);
+        }else{
+            posix_fadvise(v->fd, v->data_offset + offset, stop - offset, file_advice(advice));
+        }
+        offset = stop;
+    }
+}
+
+void cursor_open(VolumeCursor *c, const Volume *v, int advice){
+    memset(c, 0, sizeof(*c));
+    c->v = v;
+    c->advice = advice;
+}
+
+static void window_unmap(CursorWindow *w){
+    if (w->map != NULL){
+        munmap(w->map, w->map_len);
+    }
+    w->data = w->map = NULL;
+}
+
+void cursor_close(VolumeCursor *c){
+    for (int i = 0; i < CURSOR_WINDOWS; i++){
+        window_unmap(&c->windows[i]);
+    }
+    c->last = NULL;
+}
+
+//window `index`, from the ones held if it is there, else in place of the one read longest ago
+CursorWindow *cursor_window(VolumeCursor *c, uint64_t index){
+    const Volume *v = c->v;
+    CursorWindow *w = &c->windows[0];
+    for (int i = 0; i < CURSOR_WINDOWS; i++){
+        CursorWindow *x = &c->windows[i];
+        if (x->data != NULL && x->index == index){
+            x->used = ++c->clock;
+            return c->last = x;
+        }
+        if (w->data != NULL && (x->data == NULL || x->used < w->used)){
+            w = x;
+        }
+    }
+    window_unmap(w);
+    uint64_t offset = index << WINDOW_SHIFT;
+    char *chunk = atomic_load_explicit(&v->chunks[offset >> CHUNK_SHIFT], memory_order_acquire);
+    if (chunk != NULL){
+        w->data = chunk + (offset & (CHUNK_SIZE - 1));
+    }else{
+        uint64_t begin = v->data_offset + offset;
+        uint64_t end = begin + WINDOW_SIZE < v->size ? begin + WINDOW_SIZE : v->size;
+        uint64_t start = page_floor(begin);
+        w->map_len = end - start;
+        w->map = mmap(NULL, w->map_len, PROT_READ, MAP_SHARED, v->fd, start);
+        if (w->map == MAP_FAILED){
+            perror("Mapping error");
+            exit(EXIT_FAILURE);
+        }
+        madvise(w->map, w->map_len, c->advice);
+        w->data = w->map + (begin - start);
+    }
+    w->index = index;
+    w->used = ++c->clock;
+    return c->last = w;
+}
+
+int span_open(VolumeSpan *s, const Volume *v, unsigned first, unsigned count, int advice){
+    uint64_t begin = v->data_offset + volume_cluster_offset(v, first);
+    uint64_t end = begin + ((uint64_t) count << v->cluster_shift);
+    uint64_t start = page_floor(begin);
+    s->map_len = (end < v->size ? end : v->size) - start;
+    s->map = mmap(NULL, s->map_len, PROT_READ, MAP_SHARED, v->fd, start);
+    if (s->map == MAP_FAILED){
+        s->map = NULL;
+        return -1;
+    }
+    madvise(s->map, s->map_len, advice);
+    s->data = s->map + (begin - start);
+    s->first = first;
+    s->cluster_shift = v->cluster_shift;
+    return 0;
+}
+
+void span_close(VolumeSpan *s){
+    if (s->map != NULL){
+        munmap(s->map, s->map_len);
+    }
+    s->map = NULL;
+}
+
+void volume_close(Volume *v){
+    for (unsigned i = 0; v->chunks != NULL && i < v->num_chunks; i++){
+        char *chunk = atomic_load(&v->chunks[i]);
+        if (chunk != NULL){
+            uint64_t start;
+            size_t len, skip;
+            chunk_extent(v, i, &start, &len, &skip);
+            munmap(chunk - skip, len);
+        }
+    }
+    free(v->chunks);
+    if (v->fat_map != NULL) munmap(v->fat_map, v->fat_map_len);
+    close(v->fd);
+}
+
+void dir_entry_name(const DirEntry *d, char *out){
+    int i, j;
+    for (i = 0; i < 8 && d->DIR_Name[i] != ' '; i++){
+        out[i] = d->DIR_Name[i];
+    }
+    if (d->DIR_Name[8] != ' '){
+        out[i++] = '.';
+        for (j = 8; j < 11 && d->DIR_Name[j] != ' '; j++){
+            out[i++] = d->DIR_Name[j];
+        }
+    }
+    out[i] = '\0';
+}
+
+void dir_open(DirIter *it, const Volume *v, unsigned cluster){
+    it->v = v;
+    it->cluster = cluster >= 2 && cluster < v->num_clusters + 2 ? cluster : 0;
+    it->offset = 0;
+    it->steps = 0;
+}
+
+//next raw entry (deleted ones included), NULL at the end of the directory
+DirEntry *dir_next(DirIter *it){
+    const Volume *v = it->v;
+    if (it->offset == v->bytes_per_cluster){
+        it->offset = 0;
+        it->cluster = ++it->steps < v->num_clusters ? volume_next(v, it->cluster) : 0;
+    }
+    if (it->cluster == 0){
+        return NULL;
+    }
+    DirEntry *d = (DirEntry *) (volume_cluster(v, it->cluster) + it->offset);
+    if (d->DIR_Name[0] == DIR_END){
+        it->cluster = 0;
+        return NULL;
+    }
+    it->offset += sizeof(DirEntry);
+    return d;
+}
@@ -0,0 +1,217 @@
+#ifndef _VOLUME_H_
+#define _VOLUME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#pragma pack(push,1)
+typedef struct BootEntry {
+  unsigned char  BS_jmpBoot[3];     // Assembly instruction to jump to boot code
+  unsigned char  BS_OEMName[8];     // OEM Name in ASCII
+  unsigned short BPB_BytsPerSec;    // Bytes per sector. Allowed values include 512, 1024, 2048, and 4096
+  unsigned char  BPB_SecPerClus;    // Sectors per cluster (data unit). Allowed values are powers of 2, but the cluster size must be 32KB or smaller
+  unsigned short BPB_RsvdSecCnt;    // Size in sectors of the reserved area
+  unsigned char  BPB_NumFATs;       // Number of FATs
+  unsigned short BPB_RootEntCnt;    // Maximum number of files in the root directory for FAT12 and FAT16. This is 0 for FAT32
+  unsigned short BPB_TotSec16;      // 16-bit value of number of sectors in file system
+  unsigned char  BPB_Media;         // Media type
+  unsigned short BPB_FATSz16;       // 16-bit size in sectors of each FAT for FAT12 and FAT16. For FAT32, this field is 0
+  unsigned short BPB_SecPerTrk;     // Sectors per track of storage device
+  unsigned short BPB_NumHeads;      // Number of heads in storage device
+  unsigned int   BPB_HiddSec;       // Number of sectors before the start of partition
+  unsigned int   BPB_TotSec32;      // 32-bit value of number of sectors in file system. Either this value or the 16-bit value above must be 0
+  unsigned int   BPB_FATSz32;       // 32-bit size in sectors of one FAT
+  unsigned short BPB_ExtFlags;      // A flag for FAT
+  unsigned short BPB_FSVer;         // The major and minor version number
+  unsigned int   BPB_RootClus;      // Cluster where the root directory can be found
+  unsigned short BPB_FSInfo;        // Sector where FSINFO structure can be found
+  unsigned short BPB_BkBootSec;     // Sector where backup copy of boot sector is located
+  unsigned char  BPB_Reserved[12];  // Reserved
+  unsigned char  BS_DrvNum;         // BIOS INT13h drive number
+  unsigned char  BS_Reserved1;      // Not used
+  unsigned char  BS_BootSig;        // Extended boot signature to identify if the next three values are valid
+  unsigned int   BS_VolID;          // Volume serial number
+  unsigned char  BS_VolLab[11];     // Volume label in ASCII. User defines when creating the file system
+  unsigned char  BS_FilSysType[8];  // File system type label in ASCII
+} BootEntry;
+#pragma pack(pop)
+
+#pragma pack(push,1)
+typedef struct DirEntry {
+  unsigned char  DIR_Name[11];      // File name
+  unsigned char  DIR_Attr;          // File attributes
+  unsigned char  DIR_NTRes;         // Reserved
+  unsigned char  DIR_CrtTimeTenth;  // Created time (tenths of second)
+  unsigned short DIR_CrtTime;       // Created time (hours, minutes, seconds)
+  unsigned short DIR_CrtDate;       // Created day
+  unsigned short DIR_LstAccDate;    // Accessed day
+  unsigned short DIR_FstClusHI;     // High 2 bytes of the first cluster address
+  unsigned short DIR_WrtTime;       // Written time (hours, minutes, seconds
+  unsigned short DIR_WrtDate;       // Written day
+  unsigned short DIR_FstClusLO;     // Low 2 bytes of the first cluster address
+  unsigned int   DIR_FileSize;      // File size in bytes. (0 for directories)
+} DirEntry;
+#pragma pack(pop)
+
+#define FAT_EOC 0x0ffffff8      //any FAT value >= this ends a chain
+#define FAT_MASK 0x0fffffff     //top 4 bits of a FAT32 entry are reserved
+#define DIR_END 0x00            //DIR_Name[0]: no entries follow
+#define DIR_DELETED 0xE5        //DIR_Name[0]: entry was deleted
+#define ATTR_DIRECTORY 0x10
+
+//the data region is mapped a chunk at a time, the first time anything in it is read
+#define CHUNK_SHIFT 26          //64 MiB, a whole number of clusters at any cluster size
+#define CHUNK_SIZE ((uint64_t) 1 << CHUNK_SHIFT)
+
+//a VolumeCursor maps windows this size; volume_open takes no clusters larger than one
+#define WINDOW_SHIFT 22         //4 MiB
+#define WINDOW_SIZE ((uint64_t) 1 << WINDOW_SHIFT)
+#define CURSOR_WINDOWS 4
+
+//a FAT32 volume (image file or block device), with the boot sector parsed once. All byte
+//offsets are 64-bit. Chunks mapped through volume_data stay mapped until volume_close, so
+//they are kept for directories and the entries a Txn changes; bulk reads of file data go
+//through a VolumeCursor, which keeps its address space bounded however much it reads, or a
+//VolumeSpan when threads read the same clusters in any order.
+typedef struct volume{
+    int fd;
+    int writable;
+    uint64_t size;
+    BootEntry boot;
+    unsigned bytes_per_sector;
+    unsigned bytes_per_cluster;
+    unsigned cluster_shift;     //log2(bytes_per_cluster)
+    unsigned num_fats;
+    uint64_t fat_offset;        //first FAT, in bytes from the start of the volume
+    uint64_t fat_bytes;         //size of one FAT copy
+    uint64_t data_offset;       //cluster 2
+    unsigned num_clusters;      //data clusters, numbered 2 .. num_clusters + 1
+    char *fat_map;              //every FAT copy, mapped from a page boundary
+    size_t fat_map_len;
+    uint32_t *fat;              //first FAT copy
+    _Atomic(char *) *chunks;    //data region, NULL until mapped
+    unsigned num_chunks;
+} Volume;
+
+int volume_open(Volume *v, const char *path, int writable);
+void volume_close(Volume *v);
+char *volume_map_chunk(const Volume *v, unsigned chunk);
+//madvise() hint for the clusters [cluster, cluster + count), passed on with posix_fadvise()
+//where they are not mapped
+void volume_advise(const Volume *v, unsigned cluster, unsigned count, int advice);
+
+//byte `offset` of the data region; valid up to the end of its chunk
+static inline char *volume_data(const Volume *v, uint64_t offset){
+    char *chunk = atomic_load_explicit(&v->chunks[offset >> CHUNK_SHIFT], memory_order_acquire);
+    if (chunk == NULL){
+        chunk = volume_map_chunk(v, offset >> CHUNK_SHIFT);
+    }
+    return chunk + (offset & (CHUNK_SIZE - 1));
+}
+
+//bytes of data region before the cluster
+static inline uint64_t volume_cluster_offset(const Volume *v, unsigned cluster){
+    return (uint64_t) (cluster - 2) << v->cluster_shift;
+}
+
+static inline char *volume_cluster(const Volume *v, unsigned cluster){
+    return volume_data(v, volume_cluster_offset(v, cluster));
+}
+
+//A pass over file data that maps it a window at a time, with the CURSOR_WINDOWS read last
+//kept and the oldest unmapped to make room; a window inside a chunk already mapped is
+//borrowed instead. A cursor belongs to one thread.
+typedef struct cursor_window{
+    char *data;                 //the window's first byte, NULL while the slot is unused
+    char *map;                  //the mapping behind it, NULL if borrowed
+    size_t map_len;
+    uint64_t index;             //data-region offset >> WINDOW_SHIFT
+    uint64_t used;              //when it was last read, for eviction
+} CursorWindow;
+
+typedef struct volume_cursor{
+    const Volume *v;
+    int advice;                 //madvise() hint for every window mapped
+    uint64_t clock;
+    CursorWindow *last;         //the window read last
+    CursorWindow windows[CURSOR_WINDOWS];
+} VolumeCursor;
+
+void cursor_open(VolumeCursor *c, const Volume *v, int advice);
+void cursor_close(VolumeCursor *c);
+CursorWindow *cursor_window(VolumeCursor *c, uint64_t index);
+
+//byte `offset` of the data region; valid up to the end of its window, until CURSOR_WINDOWS
+//other windows have been read
+static inline const char *cursor_data(VolumeCursor *c, uint64_t offset){
+    CursorWindow *w = c->last;
+    if (w == NULL || w->index != offset >> WINDOW_SHIFT){
+        w = cursor_window(c, offset >> WINDOW_SHIFT);
+    }
+    return w->data + (offset & (WINDOW_SIZE - 1));
+}
+
+static inline const char *cursor_cluster(VolumeCursor *c, unsigned cluster){
+    return cursor_data(c, volume_cluster_offset(c->v, cluster));
+}
+
+//The clusters [first, first + count) mapped read-only as one piece, for a pass that reads
+//them in no particular order from several threads at once; unlike a cursor, it never
+//remaps anything while it is open.
+typedef struct volume_span{
+    const char *data;           //cluster `first`
+    char *map;
+    size_t map_len;
+    unsigned first;
+    unsigned cluster_shift;
+} VolumeSpan;
+
+//-1 if the clusters cannot be mapped
+int span_open(VolumeSpan *s, const Volume *v, unsigned first, unsigned count, int advice);
+void span_close(VolumeSpan *s);
+
+static inline const char *span_cluster(const VolumeSpan *s, unsigned cluster){
+    return s->data + ((uint64_t) (cluster - s->first) << s->cluster_shift);
+}
+
+//0 once the chain ends (or leaves the volume)
+static inline unsigned volume_next(const Volume *v, unsigned cluster){
+    uint32_t next = v->fat[cluster] & FAT_MASK;
+    return next >= 2 && next < FAT_EOC && next < v->num_clusters + 2 ? next : 0;
+}
+
+static inline unsigned volume_clusters_for(const Volume *v, uint64_t bytes){
+    return (bytes + v->bytes_per_cluster - 1) >> v->cluster_shift;
+}
+
+//the top 4 bits are reserved, as in a FAT entry
+static inline unsigned dir_entry_cluster(const DirEntry *d){
+    return (((unsigned) d->DIR_FstClusHI << 16) | d->DIR_FstClusLO) & FAT_MASK;
+}
+
+//8.3 name as "NAME.EXT", out must hold 13 bytes
+void dir_entry_name(const DirEntry *d, char *out);
+
+//walks the entries of a directory across its cluster chain
+typedef struct dir_iter{
+    const Volume *v;
+    unsigned cluster;
+    unsigned offset;            //of the next entry within cluster
+    unsigned steps;             //clusters visited, bounds a looping chain
+} DirIter;
+
+void dir_open(DirIter *it, const Volume *v, unsigned cluster);
+DirEntry *dir_next(DirIter *it);
+
+//volume offset of the entry dir_next just returned
+static inline uint64_t dir_offset(const DirIter *it){
+    return it->v->data_offset + volume_cluster_offset(it->v, it->cluster) + it->offset - sizeof(DirEntry);
+}
+
+//directory entry at a volume offset, as dir_offset gave it
+static inline DirEntry *volume_entry(const Volume *v, uint64_t offset){
+    return (DirEntry *) volume_data(v, offset - v->data_offset);
+}
+
+#endif